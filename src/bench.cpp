@@ -0,0 +1,730 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <set>
+#include <map>
+#include <getopt.h>
+#include <cinttypes>
+
+#include <fm_index.h>
+#include <dna_index.h>
+#include <algo.h>
+#include <parallel.h>
+
+
+
+typedef bwt::fm_index<5> dna_index;
+
+
+
+//
+// Getopt
+//
+struct args_t {
+  std::string bwtFile;
+  unsigned int depth = 27;
+  unsigned int numWalks = 100000;
+  unsigned int seed = 1;
+  unsigned int repeats = 1;
+  // synthetic bwt string, when no file is given
+  uint64_t size = 4000000;
+  double runLength = 4;
+  std::string runDist = "geometric";
+  uint64_t numStrings = 0;
+  // k-mer traversal
+  unsigned int kmerSize = 12;
+  std::vector<unsigned> threads;
+  // sections to run, all when empty
+  std::set<std::string> sections;
+  // machine readable results
+  std::string outputFile;
+  std::string baselineFile;
+  double tolerance = 0.25;
+};
+
+const char* all_sections[] = {"ops","occ_pair","mark_at","layouts","sampling","backends","compressed","batches","traversal"};
+
+// parse a comma separated list
+std::vector<std::string> split_list(const std::string& str) {
+  std::vector<std::string> v;
+  std::istringstream is(str);
+  for(std::string x;std::getline(is,x,',');) v.push_back(x);
+  return v;
+}
+
+args_t parseBenchOptions(int argc, char* argv[]) {
+	static const char* usage_message =
+	"Usage: bench [OPTION] [src.bwt]\n"
+	"Measure the speed of the libbwt hot paths on src.bwt, or on a synthetic DNA bwt string when no file is given.\n"
+	"Each section prints a table, the results can in addition be written to a JSON file, and compared to the\n"
+	"results of a previous run to flag the regressions.\n"
+	"\n"
+	"      --help                           display this help and exit\n"
+	"      -d, --depth=N                    depth of the sampled backward searches (default: 27)\n"
+	"      -n, --walks=N                    number of sampled backward searches (default: 100000)\n"
+	"      -s, --seed=N                     seed of the random generator (default: 1)\n"
+	"      -r, --repeat=N                   time each measure N times and keep the fastest, to filter out the noise\n"
+	"                                       of the other processes (default: 1)\n"
+	"      --sections=LIST                  comma separated sections to run among ops, occ_pair, mark_at, layouts,\n"
+	"                                       sampling, backends, compressed, batches and traversal (default: all)\n"
+	"\n"
+	"Synthetic bwt string:\n"
+	"      --size=N                         number of symbols (default: 4000000)\n"
+	"      --run-length=X                   mean length of the maximal runs (default: 4)\n"
+	"      --run-dist=NAME                  distribution of the run lengths: fixed, uniform (from 1 to 2X-1),\n"
+	"                                       geometric, or pareto (heavy tailed, as in repetitive collections)\n"
+	"                                       (default: geometric)\n"
+	"      --strings=N                      number of '$' of the strings of the collection (default: size/100)\n"
+	"\n"
+	"K-mer traversal:\n"
+	"      -k, --kmer-size=N                depth of the traversal of the k-mers (default: 12)\n"
+	"      -t, --threads=LIST               comma separated numbers of threads of the traversals (default: 1, 2, 4,\n"
+	"                                       ... up to the number of cores)\n"
+	"\n"
+	"Results:\n"
+	"      -o, --output=FILE                write the results to FILE in JSON\n"
+	"      --baseline=FILE                  compare the results to the ones written to FILE by a previous run, and\n"
+	"                                       exit with a failure status when one of them regressed\n"
+	"      --tolerance=X                    relative change of a result flagged as a regression (default: 0.25)\n";
+
+	enum { OPT_HELP = 1, OPT_SECTIONS, OPT_SIZE, OPT_RUN_LENGTH, OPT_RUN_DIST, OPT_STRINGS, OPT_BASELINE, OPT_TOLERANCE };
+	static const struct option longopts[] = {
+    { "depth",                 required_argument, NULL, 'd' },
+    { "walks",                 required_argument, NULL, 'n' },
+    { "seed",                  required_argument, NULL, 's' },
+    { "repeat",                required_argument, NULL, 'r' },
+    { "sections",              required_argument, NULL, OPT_SECTIONS },
+    { "size",                  required_argument, NULL, OPT_SIZE },
+    { "run-length",            required_argument, NULL, OPT_RUN_LENGTH },
+    { "run-dist",              required_argument, NULL, OPT_RUN_DIST },
+    { "strings",               required_argument, NULL, OPT_STRINGS },
+    { "kmer-size",             required_argument, NULL, 'k' },
+    { "threads",               required_argument, NULL, 't' },
+    { "output",                required_argument, NULL, 'o' },
+    { "baseline",              required_argument, NULL, OPT_BASELINE },
+    { "tolerance",             required_argument, NULL, OPT_TOLERANCE },
+    { "help",                  no_argument,       NULL, OPT_HELP },
+    { NULL, 0, NULL, 0 }
+	};
+	args_t args;
+  bool strings_set = false;
+
+  for (char c; (c = getopt_long(argc, argv, "d:n:s:r:k:t:o:", longopts, NULL)) != -1;) {
+    std::istringstream arg(optarg != NULL ? optarg : "");
+    switch (c) {
+      case 'd': arg >> args.depth; break;
+      case 'n': arg >> args.numWalks; break;
+      case 's': arg >> args.seed; break;
+      case 'r': arg >> args.repeats; break;
+      case OPT_SECTIONS:
+        for(const auto& s:split_list(arg.str())) {
+          if (std::find(std::begin(all_sections),std::end(all_sections),s) == std::end(all_sections)) {
+            std::cerr << "bench: unknown section " << s << "\n";
+            exit(EXIT_FAILURE);
+          }
+          args.sections.insert(s);
+        }
+        break;
+      case OPT_SIZE: arg >> args.size; break;
+      case OPT_RUN_LENGTH: arg >> args.runLength; break;
+      case OPT_RUN_DIST: args.runDist = arg.str(); break;
+      case OPT_STRINGS: arg >> args.numStrings; strings_set = true; break;
+      case 'k': arg >> args.kmerSize; break;
+      case 't':
+        for(const auto& s:split_list(arg.str())) args.threads.push_back(std::stoul(s));
+        break;
+      case 'o': args.outputFile = arg.str(); break;
+      case OPT_BASELINE: args.baselineFile = arg.str(); break;
+      case OPT_TOLERANCE: arg >> args.tolerance; break;
+      case OPT_HELP:
+        std::cout << usage_message;
+        exit(EXIT_SUCCESS);
+    }
+  }
+
+  if (argc - optind > 1) {
+    std::cerr << "bench: expect at most one bwt file\n";
+    std::cout << "\n" << usage_message;
+    exit(EXIT_FAILURE);
+  }
+  if (optind < argc) args.bwtFile = argv[optind];
+
+  if (args.runDist != "fixed" && args.runDist != "uniform" && args.runDist != "geometric" && args.runDist != "pareto") {
+    std::cerr << "bench: unknown run length distribution " << args.runDist << "\n";
+    exit(EXIT_FAILURE);
+  }
+  if (args.size == 0 || args.runLength < 1 || args.kmerSize == 0 || args.numWalks == 0 || args.repeats == 0) {
+    std::cerr << "bench: invalid synthetic string or traversal parameters\n";
+    std::cout << "\n" << usage_message;
+    exit(EXIT_FAILURE);
+  }
+  if (!strings_set) args.numStrings = args.size / 100;
+  if (args.threads.empty()) {
+    for(unsigned t = 1; t < bwt::default_num_threads(); t *= 2) args.threads.push_back(t);
+    args.threads.push_back(bwt::default_num_threads());
+  }
+  if (std::count(args.threads.begin(),args.threads.end(),0u)) {
+    std::cerr << "bench: invalid number of threads\n";
+    exit(EXIT_FAILURE);
+  }
+
+  return args;
+}
+
+bool section_enabled(const args_t& args, const char* name) {return args.sections.empty() || args.sections.count(name);}
+
+
+
+//
+// Synthetic bwt string
+//
+
+// generate a DNA bwt string of args.size symbols: maximal runs of A, C, G and T whose lengths follow the distribution
+// args.runDist of mean args.runLength, and the sentinels of about args.numStrings strings as single '$' between them.
+// The string isn't the bwt of a collection, but its ranks and the intervals of its searches behave as in one.
+bwt::rle_string synthetic_bwt(const args_t& args) {
+  std::mt19937_64 rng(args.seed);
+  std::uniform_real_distribution<double> uniform(0,1);
+  std::geometric_distribution<uint64_t> geometric(1 / args.runLength);
+  const double pareto_shape = 1.5, pareto_scale = args.runLength * (pareto_shape - 1) / pareto_shape;
+  auto run_length = [&]() -> uint64_t {
+    if (args.runDist == "fixed") return std::llround(args.runLength);
+    if (args.runDist == "uniform") return 1 + rng() % std::max<uint64_t>(1,std::llround(2 * args.runLength - 1));
+    if (args.runDist == "geometric") return 1 + geometric(rng);
+    return std::max(1.0,std::min(1e12,std::round(pareto_scale / std::pow(1 - uniform(rng),1 / pareto_shape))));
+  };
+  const double sentinel_rate = std::min(1.0,args.numStrings * args.runLength / args.size);
+
+  bwt::rle_string bwt;
+  uint8_t last = 0;
+  while (bwt.size() < args.size) {
+    if (uniform(rng) < sentinel_rate) {
+      bwt.push_back(0);
+      last = 0;
+    }
+    // a run of another symbol than the previous one
+    uint8_t c = 1 + rng() % (last ? 3 : 4);
+    if (last && c >= last) ++c;
+    bwt.append(c,std::min(run_length(),args.size - bwt.size()));
+    last = c;
+  }
+  return bwt;
+}
+
+
+
+//
+// Benchmark helpers
+//
+
+// number of executions of each timed function, see --repeat
+unsigned int repeats = 1;
+
+// time the fastest of the executions of f(), in nanoseconds
+template<typename Function>
+double time_ns(Function f) {
+  double best = 0;
+  for(unsigned int r = 0; r < repeats; ++r) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    const double t = std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now() - start).count();
+    if (r == 0 || t < best) best = t;
+  }
+  return best;
+}
+
+// keeps the checksums of the timed loops alive
+volatile uint64_t sink;
+
+// results of the benchmarks, written to the JSON output and compared to the baseline
+struct result_t {
+  std::string name;
+  double value;
+  std::string unit;
+};
+std::vector<result_t> results;
+
+void record(const std::string& name, double value, const std::string& unit) {results.push_back(result_t{name,value,unit});}
+
+typedef std::vector< std::vector< std::pair<uint64_t,uint64_t> > > depth_intervals;
+
+// sample the non-empty intervals met at each depth of random backward searches, as a DFS would visit them
+depth_intervals sample_intervals(const dna_index& fm, const args_t& args) {
+  depth_intervals intervals(args.depth);
+  std::mt19937_64 rng(args.seed);
+  dna_index::alpha_count64 lb,ub;
+  for(unsigned int w = 0; w < args.numWalks; ++w) {
+    bwt::alpha_range(fm,lb,ub);
+    for(unsigned int d = 0; d < args.depth; ++d) {
+      // pick a random non-empty extension, weighted by its size like a random position of the text would
+      uint64_t total = 0;
+      for(size_t c = 1; c < fm.alphabet_size(); ++c) total += ub[c] - lb[c];
+      if (total == 0) break;
+      uint64_t r = rng() % total;
+      size_t c = 1;
+      while (r >= ub[c] - lb[c]) { r -= ub[c] - lb[c]; ++c; }
+      intervals[d].push_back(std::make_pair(lb[c],ub[c]));
+      bwt::extend_lhs(fm,lb,ub,c);
+    }
+  }
+  return intervals;
+}
+
+
+
+// sample substrings of the text of length depth, with LF walks from random positions
+std::vector<std::string> sample_patterns(const dna_index& fm, const args_t& args) {
+  std::mt19937_64 rng(args.seed);
+  std::vector<std::string> patterns;
+  while (patterns.size() < args.numWalks) {
+    std::string p;
+    for(uint64_t i = rng() % fm.bwt().size(); p.size() < args.depth;) {
+      const uint8_t c = fm[i];
+      if (c == 0) break;
+      p.push_back(c);
+      i = fm.lf(i)[c] - 1;
+    }
+    std::reverse(p.begin(),p.end());
+    if (p.size() == args.depth) patterns.push_back(p);
+  }
+  return patterns;
+}
+
+
+
+// random positions of the bwt string
+std::vector<uint64_t> sample_positions(const dna_index& fm, const args_t& args) {
+  std::mt19937_64 rng(args.seed);
+  std::vector<uint64_t> pos(args.numWalks);
+  for(auto& p:pos) p = rng() % fm.bwt().size();
+  return pos;
+}
+
+
+
+//
+// Benchmarks
+//
+
+// time the basic operations of the index at random positions, and extend_lhs() on the sampled intervals
+void bench_ops(const dna_index& fm, const depth_intervals& intervals, const args_t& args) {
+  const auto pos = sample_positions(fm,args);
+  std::cout << "# operations at random positions, extend_lhs() on the sampled intervals (ns/op), runs scanned per rank" << std::endl;
+  std::cout << "op\tns/op" << std::endl;
+  uint64_t checksum = 0;
+  auto report = [&](const char* name, double t, size_t n) {
+    std::cout << name << '\t' << t / n << std::endl;
+    record(std::string("ops/") + name,t / n,"ns/op");
+  };
+  report("occ",time_ns([&]() {for(auto p:pos) checksum += fm.occ(p)[2];}),pos.size());
+  report("lf",time_ns([&]() {for(auto p:pos) checksum += fm.lf(p)[3];}),pos.size());
+  report("lf_step",time_ns([&]() {for(auto p:pos) checksum += fm.lf_step(p).second;}),pos.size());
+  report("access",time_ns([&]() {for(auto p:pos) checksum += fm[p];}),pos.size());
+  size_t n = 0;
+  dna_index::alpha_count64 low, high;
+  double t = time_ns([&]() {
+    for(const auto& v:intervals) {
+      for(const auto& x:v) {
+        bwt::extend_lhs(fm,low,high,x.first,x.second);
+        checksum += low[1] + high[4];
+        ++n;
+      }
+    }
+  });
+  report("extend_lhs",t,std::max<size_t>(1,n));
+  sink = checksum;
+
+  // runs read by the ranks, measured at the sampled positions against the expectation from the average run length
+  double scanned = 0;
+  for(auto p:pos) scanned += fm.scanned_runs(p);
+  std::cout << "runs_scanned\t" << scanned / pos.size() << " (expected " << fm.expected_scanned_runs() << ")" << std::endl;
+  record("ops/runs_scanned",scanned / pos.size(),"runs/query");
+}
+
+
+
+// compare the rank of both bounds of the intervals with two occ() against occ_pair()
+void bench_occ_pair(const dna_index& fm, const depth_intervals& intervals) {
+  std::cout << "# extend_lhs ranks per depth: two occ() vs occ_pair() (ns/op)" << std::endl;
+  std::cout << "depth\tintervals\tavg_width\tocc_x2\tocc_pair\tspeedup" << std::endl;
+  double total2 = 0, total1 = 0;
+  size_t total = 0;
+  for(size_t d = 0; d < intervals.size(); ++d) {
+    const auto& v = intervals[d];
+    if (v.empty()) break;
+    uint64_t checksum = 0;
+    double width = 0;
+    for(const auto& x:v) width += x.second - x.first;
+
+    double t2 = time_ns([&]() {
+      for(const auto& x:v) {
+        if (x.first == 0) continue;
+        checksum += fm.occ(x.first-1)[1] + fm.occ(x.second-1)[1];
+      }
+    });
+    double t1 = time_ns([&]() {
+      for(const auto& x:v) {
+        if (x.first == 0) continue;
+        auto n = fm.occ_pair(x.first-1,x.second-1);
+        checksum -= n.first[1] + n.second[1];
+      }
+    });
+    if (checksum != 0) throw std::logic_error("occ_pair() and occ() disagree");
+    std::cout << d+1 << '\t' << v.size() << '\t' << width / v.size() << '\t' << t2 / v.size() << '\t' << t1 / v.size() << '\t' << t2 / t1 << std::endl;
+    total2 += t2;
+    total1 += t1;
+    total += v.size();
+  }
+  if (total) {
+    record("occ_pair/occ_x2",total2 / total,"ns/op");
+    record("occ_pair/occ_pair",total1 / total,"ns/op");
+  }
+}
+
+
+
+// compare the run decoding kernels on occ() at random positions
+void bench_mark_at(dna_index& fm, const args_t& args) {
+  const auto pos = sample_positions(fm,args);
+  std::cout << "# occ() at random positions per run decoding kernel (ns/op)" << std::endl;
+  std::cout << "simd\tocc" << std::endl;
+  uint64_t ref = 0;
+  for(int level = bwt::SIMD_SCALAR; level <= bwt::detect_simd_level(); ++level) {
+    fm.set_simd_level(static_cast<bwt::simd_level>(level));
+    uint64_t checksum = 0;
+    double t = time_ns([&]() {for(auto p:pos) checksum += fm.occ(p)[2];});
+    if (level == bwt::SIMD_SCALAR) ref = checksum;
+    if (checksum != ref) throw std::logic_error("run decoding kernels disagree");
+    const char* name = bwt::simd_level_name(static_cast<bwt::simd_level>(level));
+    std::cout << name << '\t' << t / pos.size() << std::endl;
+    record(std::string("mark_at/") + name,t / pos.size(),"ns/op");
+  }
+  fm.set_simd_level(bwt::detect_simd_level());
+}
+
+
+
+// compare the layouts of the small marks on occ() at random positions and on the ranks of a whole DFS
+template<typename Index>
+void bench_layout(const std::string& name, const Index& fm, const std::vector<uint64_t>& pos, const depth_intervals& intervals, uint64_t& checksum) {
+  double t_occ = time_ns([&]() {for(auto p:pos) checksum += fm.occ(p)[2];});
+  size_t n = 0;
+  double t_dfs = time_ns([&]() {
+    for(const auto& v:intervals) {
+      for(const auto& x:v) {
+        if (x.first == 0) continue;
+        auto r = fm.occ_pair(x.first-1,x.second-1);
+        checksum += r.first[1] + r.second[3];
+        ++n;
+      }
+    }
+  });
+  n = std::max<size_t>(1,n);
+  std::cout << t_occ / pos.size() << '\t' << t_dfs / n << std::endl;
+  record(name + "/occ",t_occ / pos.size(),"ns/op");
+  record(name + "/occ_pair",t_dfs / n,"ns/op");
+}
+
+void bench_layouts(const dna_index& fm, const depth_intervals& intervals, const args_t& args) {
+  const auto pos = sample_positions(fm,args);
+  bwt::fm_index<5,bwt::interleaved_marks> ifm(fm.bwt());
+
+  std::cout << "# layout of the small marks: occ() at random positions, occ_pair() on the sampled intervals (ns/op)" << std::endl;
+  std::cout << "layout\tmarks_MB\tocc\tocc_pair" << std::endl;
+  uint64_t c1 = 0, c2 = 0;
+  std::cout << "split\t" << fm.marks_bytes() / 1e6 << '\t';
+  bench_layout("layouts/split",fm,pos,intervals,c1);
+  std::cout << "interleaved\t" << ifm.marks_bytes() / 1e6 << '\t';
+  bench_layout("layouts/interleaved",ifm,pos,intervals,c2);
+  if (c1 != c2) throw std::logic_error("mark layouts disagree");
+}
+
+
+
+// compare the sampling rates of the small marks: memory of the marks against occ() at random positions
+void bench_sampling(const dna_index& fm, const args_t& args) {
+  const auto pos = sample_positions(fm,args);
+  std::cout << "# sampling of the small marks: memory against occ() at random positions (ns/op)" << std::endl;
+  std::cout << "interval\tmarks_MB\tbytes/symbol\texpected_runs\tscanned_runs\tocc" << std::endl;
+  uint64_t ref = 0;
+  for(unsigned s16 = 5; s16 <= 11; ++s16) {
+    dna_index sfm(fm.bwt(),bwt::default_num_threads(),bwt::fm_sampling(s16));
+    uint64_t checksum = 0;
+    double t = time_ns([&]() {for(auto p:pos) checksum += sfm.occ(p)[2];});
+    if (s16 == 5) ref = checksum;
+    if (checksum != ref) throw std::logic_error("samplings disagree");
+    double scanned = 0;
+    for(auto p:pos) scanned += sfm.scanned_runs(p);
+    const double n = sfm.bwt().size();
+    const std::string name = "sampling/" + std::to_string(1u<<s16);
+    std::cout << (1u<<s16) << '\t' << sfm.marks_bytes() / 1e6 << '\t' << (sfm.bwt().runs().size() + sfm.marks_bytes()) / n << '\t' << sfm.expected_scanned_runs() << '\t' << scanned / pos.size() << '\t' << t / pos.size() << std::endl;
+    record(name + "/bytes_per_symbol",(sfm.bwt().runs().size() + sfm.marks_bytes()) / n,"bytes/symbol");
+    record(name + "/runs_scanned",scanned / pos.size(),"runs/query");
+    record(name + "/occ",t / pos.size(),"ns/op");
+  }
+}
+
+
+
+// compare the run-length, the packed, the runs and the compressed backends: memory against occ() at random positions and on the ranks of a whole DFS
+void bench_backends(const dna_index& fm, const depth_intervals& intervals, const args_t& args) {
+  const auto pos = sample_positions(fm,args);
+  bwt::packed_dna_index pfm(fm.bwt());
+  bwt::run_dna_index rfm(fm.bwt());
+  bwt::compressed_fm_index<5> cfm(fm.bwt());
+
+  std::cout << "# backend (auto: " << bwt::dna_index::backend_name(bwt::dna_index::select_backend(fm.bwt())) << "): bytes/symbol of the runs and of the index, total held once"
+            << " the BWT file is mapped and the runs released by the backends no longer reading them, occ() at random positions, occ_pair() on the"
+            << " sampled intervals (ns/op)" << std::endl;
+  std::cout << "backend\truns\tindex\ttotal\tocc\tocc_pair" << std::endl;
+  const double n = fm.bwt().size();
+  const double runs = fm.bwt().runs().size() * sizeof(bwt::run_t);
+  uint64_t c1 = 0, c2 = 0, c3 = 0, c4 = 0;
+  auto report = [&](bwt::dna_index::backend_t backend, double bytes) {
+    const std::string name = bwt::dna_index::backend_name(backend);
+    const double total = bytes + (bwt::dna_index::releases_bwt(backend) ? 0 : runs);
+    std::cout << name << '\t' << runs / n << '\t' << bytes / n << '\t' << total / n << '\t';
+    record("backends/" + name + "/bytes_per_symbol",total / n,"bytes/symbol");
+    return "backends/" + name;
+  };
+  bench_layout(report(bwt::dna_index::RLE_BACKEND,fm.marks_bytes()),fm,pos,intervals,c1);
+  bench_layout(report(bwt::dna_index::PACKED_BACKEND,pfm.marks_bytes()),pfm,pos,intervals,c2);
+  bench_layout(report(bwt::dna_index::RUNS_BACKEND,rfm.marks_bytes()),rfm,pos,intervals,c3);
+  bench_layout(report(bwt::dna_index::COMPRESSED_BACKEND,cfm.marks_bytes()),cfm,pos,intervals,c4);
+  if (c1 != c2 || c1 != c3 || c1 != c4) throw std::logic_error("backends disagree");
+}
+
+
+
+// compare the block sizes of the compressed index, with and without the cache of the decoded blocks, against the
+// run-length index with the same sampling
+void bench_compressed(const dna_index& fm, const depth_intervals& intervals, const args_t& args) {
+  const auto pos = sample_positions(fm,args);
+  std::cout << "# compressed runs per block size: bytes/symbol, occ() at random positions, occ_pair() on the sampled intervals (ns/op)" << std::endl;
+  std::cout << "block\tindex\tbytes/symbol\tocc\tocc_pair" << std::endl;
+  const double n = fm.bwt().size();
+  for(unsigned s16:{7,9,11}) {
+    const dna_index sfm(fm.bwt(),bwt::default_num_threads(),bwt::fm_sampling(s16));
+    bwt::compressed_fm_index<5> cfm(fm.bwt(),bwt::fm_sampling(s16));
+    const std::string block = std::to_string(1u<<s16);
+    uint64_t c1 = 0, c2 = 0, c3 = 0;
+    std::cout << block << "\trle\t" << (sfm.bwt().runs().size() + sfm.marks_bytes()) / n << '\t';
+    bench_layout("compressed/" + block + "/rle",sfm,pos,intervals,c1);
+    std::cout << block << "\tcompressed\t" << cfm.marks_bytes() / n << '\t';
+    record("compressed/" + block + "/bytes_per_symbol",cfm.marks_bytes() / n,"bytes/symbol");
+    bench_layout("compressed/" + block + "/compressed",cfm,pos,intervals,c2);
+    cfm.set_cache(false);
+    std::cout << block << "\tcompressed-nocache\t" << cfm.marks_bytes() / n << '\t';
+    bench_layout("compressed/" + block + "/compressed-nocache",cfm,pos,intervals,c3);
+    if (c1 != c2 || c1 != c3) throw std::logic_error("compressed index disagree");
+  }
+}
+
+
+
+// compare the backward searches one at a time against the batched searches of backward_search_batch()
+template<typename Index>
+void bench_batch(const char* name, const Index& fm, const std::vector<std::string>& patterns) {
+  std::vector< std::pair<uint64_t,uint64_t> > ranges, ref(patterns.size());
+  double t = time_ns([&]() {
+    for(size_t j = 0; j < patterns.size(); ++j) ref[j] = bwt::backward_search(fm,patterns[j].begin(),patterns[j].end());
+  });
+  std::cout << name << '\t' << t / patterns.size();
+  record(std::string("batches/") + name + "/single",t / patterns.size(),"ns/op");
+  for(size_t batch_size:{8,32,128}) {
+    double tb = time_ns([&]() {bwt::backward_search_batch(fm,patterns,ranges,batch_size);});
+    if (ranges != ref) throw std::logic_error("batched searches disagree");
+    std::cout << '\t' << tb / patterns.size();
+    record(std::string("batches/") + name + "/batch" + std::to_string(batch_size),tb / patterns.size(),"ns/op");
+  }
+  std::cout << std::endl;
+}
+
+void bench_batches(const dna_index& fm, const args_t& args) {
+  auto patterns = sample_patterns(fm,args);
+  std::cout << "# backward search of " << patterns.size() << " substrings of length " << args.depth << ": one at a time vs batches of 8, 32, 128 (ns/search)" << std::endl;
+  std::cout << "index\tsingle\tbatch8\tbatch32\tbatch128" << std::endl;
+  bench_batch("split",fm,patterns);
+  bench_batch("interleaved",bwt::fm_index<5,bwt::interleaved_marks>(fm.bwt()),patterns);
+  bench_batch("packed",bwt::packed_dna_index(fm.bwt()),patterns);
+}
+
+
+
+// depth first traversal of the k-mers of the bwt string with extend_lhs(), as done by kmer-count without its output,
+// the subtrees of the strings of the first 3 symbols being distributed to the threads
+// \return the number of nodes visited and the number of k-mers
+std::pair<uint64_t,uint64_t> traverse_kmers(const dna_index& fm, unsigned k, unsigned num_threads) {
+  struct node_t {uint64_t first, last; unsigned depth;};
+  const unsigned p = std::min(k,3u);
+  const size_t num_prefixes = size_t(1) << (2 * p);
+  std::vector< std::pair<uint64_t,uint64_t> > counts(num_prefixes);
+  bwt::parallel_for(num_prefixes,num_threads,[&](size_t x) {
+    std::string prefix;
+    for(unsigned j = 0; j < p; ++j) prefix.push_back(1 + ((x >> (2*j)) & 3));
+    const auto r = bwt::backward_search(fm,prefix.begin(),prefix.end());
+    if (r.first >= r.second) return;
+    std::vector<node_t> stack(1,node_t{r.first,r.second,p});
+    dna_index::alpha_count64 low, high;
+    uint64_t nodes = 0, kmers = 0;
+    while (!stack.empty()) {
+      const node_t e = stack.back();
+      stack.pop_back();
+      ++nodes;
+      if (e.depth == k) {++kmers;continue;}
+      bwt::extend_lhs(fm,low,high,e.first,e.last);
+      for(uint8_t c = 1; c < fm.alphabet_size(); ++c) {
+        if (low[c] < high[c]) stack.push_back(node_t{low[c],high[c],e.depth + 1});
+      }
+    }
+    counts[x] = std::make_pair(nodes,kmers);
+  });
+  std::pair<uint64_t,uint64_t> total(0,0);
+  for(const auto& c:counts) {
+    total.first += c.first;
+    total.second += c.second;
+  }
+  return total;
+}
+
+void bench_traversal(const dna_index& fm, const args_t& args) {
+  std::cout << "# traversal of the " << args.kmerSize << "-mers per number of threads (nodes/s)" << std::endl;
+  std::cout << "threads\tseconds\tnodes\tkmers\tnodes/s\tspeedup" << std::endl;
+  double ref = 0;
+  std::pair<uint64_t,uint64_t> ref_counts;
+  for(auto t:args.threads) {
+    std::pair<uint64_t,uint64_t> counts;
+    const double s = time_ns([&]() {counts = traverse_kmers(fm,args.kmerSize,t);}) / 1e9;
+    if (ref == 0) {
+      ref = s;
+      ref_counts = counts;
+    }
+    if (counts != ref_counts) throw std::logic_error("traversals disagree");
+    std::cout << t << '\t' << s << '\t' << counts.first << '\t' << counts.second << '\t' << counts.first / s << '\t' << ref / s << std::endl;
+    record("traversal/k" + std::to_string(args.kmerSize) + "/threads" + std::to_string(t) + "/nodes_per_s",counts.first / s,"nodes/s");
+  }
+}
+
+
+
+//
+// Results
+//
+
+// description of the bwt string and of the sampling of the benchmarks, as a JSON object
+std::string input_description(const dna_index& fm, const args_t& args) {
+  std::ostringstream os;
+  os << "{";
+  if (args.bwtFile.empty()) {
+    os << "\"synthetic\": true, \"run_dist\": \"" << args.runDist << "\", \"run_length\": " << args.runLength << ", \"strings\": " << args.numStrings << ", ";
+  } else {
+    os << "\"file\": \"" << args.bwtFile << "\", ";
+  }
+  os << "\"size\": " << fm.bwt().size() << ", \"runs\": " << fm.bwt().runs().size() << ", \"seed\": " << args.seed;
+  os << ", \"walks\": " << args.numWalks << ", \"depth\": " << args.depth << ", \"kmer_size\": " << args.kmerSize;
+  os << ", \"simd\": \"" << bwt::simd_level_name(bwt::detect_simd_level()) << "\"}";
+  return os.str();
+}
+
+// write the description of the input and the results to a JSON file, one result per line
+void write_results(const std::string& filename, const dna_index& fm, const args_t& args) {
+  std::ofstream os(filename);
+  if (!os) throw std::runtime_error("unable to create " + filename);
+  os << std::setprecision(6);
+  os << "{\n";
+  os << "  \"input\": " << input_description(fm,args) << ",\n";
+  os << "  \"results\": [\n";
+  for(size_t i = 0; i < results.size(); ++i) {
+    os << "    {\"name\": \"" << results[i].name << "\", \"value\": " << results[i].value << ", \"unit\": \"" << results[i].unit << "\"}";
+    os << (i + 1 < results.size() ? ",\n" : "\n");
+  }
+  os << "  ]\n}\n";
+  if (!os) throw std::runtime_error("error while writing " + filename);
+}
+
+// read the results of a file written by write_results(), and the description of its input
+std::map<std::string,result_t> read_results(const std::string& filename, std::string& input) {
+  std::ifstream is(filename);
+  if (!is) throw std::runtime_error("unable to open " + filename);
+  std::map<std::string,result_t> r;
+  auto field = [](const std::string& line, const std::string& key) -> std::string {
+    const std::string k = "\"" + key + "\": ";
+    size_t i = line.find(k);
+    if (i == std::string::npos) return "";
+    i += k.size();
+    if (line[i] == '"') return line.substr(i + 1,line.find('"',i + 1) - i - 1);
+    return line.substr(i,line.find_first_of(",}",i) - i);
+  };
+  const std::string input_key = "  \"input\": ";
+  for(std::string line;std::getline(is,line);) {
+    if (line.compare(0,input_key.size(),input_key) == 0) input = line.substr(input_key.size(),line.rfind('}') + 1 - input_key.size());
+    const std::string name = field(line,"name");
+    if (name.empty()) continue;
+    r[name] = result_t{name,std::stod(field(line,"value")),field(line,"unit")};
+  }
+  return r;
+}
+
+// compare the results to the baseline: a result regresses when it changes by more than the tolerance in the wrong
+// direction, the rates (units per second) being better when higher and the others when lower
+// \return the number of regressions
+size_t check_baseline(const dna_index& fm, const args_t& args) {
+  std::string input;
+  const auto baseline = read_results(args.baselineFile,input);
+  std::cout << "# comparison with " << args.baselineFile << " (tolerance " << 100 * args.tolerance << "%)" << std::endl;
+  if (input != input_description(fm,args)) std::cout << "# warning: the baseline was measured on another input: " << input << std::endl;
+  std::cout << "name\tunit\tbaseline\tcurrent\tchange\tstatus" << std::endl;
+  size_t regressions = 0;
+  for(const auto& r:results) {
+    const auto it = baseline.find(r.name);
+    if (it == baseline.end() || it->second.unit != r.unit) continue;
+    const double b = it->second.value;
+    const double change = b != 0 ? (r.value - b) / b : 0;
+    const bool rate = r.unit.size() > 2 && r.unit.compare(r.unit.size() - 2,2,"/s") == 0;
+    const double worse = rate ? -change : change;
+    const char* status = worse > args.tolerance ? "REGRESSION" : worse < -args.tolerance ? "improved" : "ok";
+    if (worse > args.tolerance) ++regressions;
+    std::cout << r.name << '\t' << r.unit << '\t' << b << '\t' << r.value << '\t' << std::showpos << 100 * change << std::noshowpos << "%\t" << status << std::endl;
+  }
+  std::cout << "# " << regressions << " regression(s)" << std::endl;
+  return regressions;
+}
+
+
+
+//
+// Main
+//
+
+int main(int argc, char* argv[]) {
+	try {
+    args_t args = parseBenchOptions(argc,argv);
+    repeats = args.repeats;
+    dna_index fm(args.bwtFile.empty() ? synthetic_bwt(args) : bwt::read_rle_bwt(args.bwtFile));
+    if (args.bwtFile.empty()) {
+      std::cout << "# synthetic bwt: " << args.runDist << " runs of mean length " << args.runLength << ", " << fm.C()[1] << " strings" << std::endl;
+    }
+    std::cout << "# " << fm.bwt().size() << " symbols, " << fm.bwt().runs().size() << " runs (" << fm.bwt().avg_run_length() << " symbols/run)" << std::endl;
+    auto intervals = sample_intervals(fm,args);
+    std::cout << std::fixed << std::setprecision(2);
+    if (section_enabled(args,"ops")) bench_ops(fm,intervals,args);
+    if (section_enabled(args,"occ_pair")) bench_occ_pair(fm,intervals);
+    if (section_enabled(args,"mark_at")) bench_mark_at(fm,args);
+    if (section_enabled(args,"layouts")) bench_layouts(fm,intervals,args);
+    if (section_enabled(args,"sampling")) bench_sampling(fm,args);
+    if (section_enabled(args,"backends")) bench_backends(fm,intervals,args);
+    if (section_enabled(args,"compressed")) bench_compressed(fm,intervals,args);
+    if (section_enabled(args,"batches")) bench_batches(fm,args);
+    if (section_enabled(args,"traversal")) bench_traversal(fm,args);
+    if (!args.outputFile.empty()) write_results(args.outputFile,fm,args);
+    if (!args.baselineFile.empty() && check_baseline(fm,args) > 0) return EXIT_FAILURE;
+	} catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+	};
+  return 0;
+}
@@ -0,0 +1,234 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <getopt.h>
+#include <cinttypes>
+#include <algorithm>
+#include <sys/resource.h>
+
+#include <bcr.h>
+#include <bcr_external.h>
+#include <dna_index.h>
+#include <merge.h>
+
+
+
+//
+// Getopt
+//
+struct args_t {
+  std::vector<std::string> readFiles;
+  std::string outputFile;
+  unsigned numThreads = bwt::default_num_threads();
+  bool reverse = false;
+  uint64_t memory = 0;
+  std::string tmpDir;
+  std::string appendFile;
+};
+
+// parse a size in bytes, with an optional K, M or G suffix
+uint64_t parse_size(const std::string& str) {
+  std::istringstream is(str);
+  uint64_t n;
+  std::string unit;
+  if (!(is >> n) || (is >> unit && unit != "K" && unit != "M" && unit != "G") || n == 0) throw std::invalid_argument("invalid size: " + str);
+  const int shift = unit == "K" ? 10 : unit == "M" ? 20 : unit == "G" ? 30 : 0;
+  return n << shift;
+}
+
+args_t parseBwtBuildOptions(int argc, char* argv[]) {
+	static const char* usage_message =
+	"Usage: bwt-build [OPTION] -o out.bwt reads1.fa [reads2.fq ...]\n"
+	"Build the BWT of the reads of FASTA/FASTQ files with the BCR algorithm, and save it in the SGA run-length\n"
+	"encoded format read by the other tools. Row i of the BWT is the end of the i-th read of the files.\n"
+	"The reads with other symbols than A, C, G and T are skipped.\n"
+	"\n"
+	"      --help                           display this help and exit\n"
+	"      -o, --output=FILE                write the BWT to FILE\n"
+	"      -t, --threads=N                  number of threads to use (default: number of cores)\n"
+	"      -r, --reverse                    build the BWT of the reversed reads, that kmer-count uses as X.rbwt\n"
+	"      -a, --append=FILE                append the reads to the collection of the BWT FILE, without sorting its\n"
+	"                                       suffixes again: the BWT of the reads is built and merged after it\n"
+	"      -M, --memory=SIZE                build the BWT on disk, with at most SIZE bytes of buffers (suffix K, M or G).\n"
+	"                                       The reads are transposed into temporary files, and the partial BWT and the\n"
+	"                                       insertions of each round are streamed from and to temporary files. SIZE\n"
+	"                                       must hold one byte per read and 156K of buffers, fewer threads merging at\n"
+	"                                       once when the buffers of all of them don't fit\n"
+	"      --tmp-dir=DIR                    with --memory, directory of the temporary files (default: the directory of\n"
+	"                                       the output file)\n"
+	"\n"
+	"The peak resident memory of the process is reported at the end.\n";
+
+	enum { OPT_HELP = 1, OPT_TMP_DIR };
+	static const struct option longopts[] = {
+    { "output",                required_argument, NULL, 'o' },
+    { "threads",               required_argument, NULL, 't' },
+    { "reverse",               no_argument,       NULL, 'r' },
+    { "memory",                required_argument, NULL, 'M' },
+    { "append",                required_argument, NULL, 'a' },
+    { "tmp-dir",               required_argument, NULL, OPT_TMP_DIR },
+    { "help",                  no_argument,       NULL, OPT_HELP },
+    { NULL, 0, NULL, 0 }
+	};
+	args_t args;
+
+  for (char c; (c = getopt_long(argc, argv, "o:t:rM:a:", longopts, NULL)) != -1;) {
+    std::istringstream arg(optarg != NULL ? optarg : "");
+    try {
+      switch (c) {
+        case 'o': arg >> args.outputFile; break;
+        case 't': arg >> args.numThreads; break;
+        case 'r': args.reverse = true; break;
+        case 'M': args.memory = parse_size(arg.str()); break;
+        case OPT_TMP_DIR: args.tmpDir = arg.str(); break;
+        case 'a': args.appendFile = arg.str(); break;
+        case OPT_HELP:
+          std::cout << usage_message;
+          exit(EXIT_SUCCESS);
+      }
+    } catch (const std::invalid_argument& e) {
+      std::cerr << "bwt-build: " << e.what() << "\n";
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (args.numThreads == 0) {
+    std::cerr << "bwt-build: invalid number of threads\n";
+    std::cout << "\n" << usage_message;
+    exit(EXIT_FAILURE);
+  }
+
+  if (args.outputFile.empty()) {
+    std::cerr << "bwt-build: missing output file\n";
+    std::cout << "\n" << usage_message;
+    exit(EXIT_FAILURE);
+  }
+
+  if (args.memory && !args.appendFile.empty()) {
+    std::cerr << "bwt-build: --append is incompatible with --memory\n";
+    exit(EXIT_FAILURE);
+  }
+
+  for(;optind<argc;++optind) args.readFiles.push_back(argv[optind]);
+  if (args.readFiles.empty()) {
+    std::cerr << "bwt-build: missing arguments\n";
+    std::cout << "\n" << usage_message;
+    exit(EXIT_FAILURE);
+  }
+
+  return args;
+}
+
+
+
+//
+// Reads
+//
+
+// encode a read with the symbols of the bwt, A, C, G and T being 1 to 4
+// \return false when the read has another symbol
+bool encode_read(std::string& read) {
+  for(auto& c:read) {
+    switch (c) {
+      case 'A': case 'a': c = 1; break;
+      case 'C': case 'c': c = 2; break;
+      case 'G': case 'g': c = 3; break;
+      case 'T': case 't': c = 4; break;
+      default: return false;
+    }
+  }
+  return true;
+}
+
+// call add_read on each encoded read of a FASTA or FASTQ file, the records being recognized by their first character
+// \return the number of reads skipped
+template<typename Function>
+uint64_t load_reads(const std::string& filename, bool reverse, Function add_read) {
+  std::ifstream is(filename);
+  if (!is) throw std::runtime_error("unable to open " + filename);
+  uint64_t skipped = 0;
+  std::string line, read;
+  bool fasta = false;
+  auto add = [&]() {
+    if (encode_read(read)) {
+      if (reverse) std::reverse(read.begin(),read.end());
+      add_read(read);
+    } else {
+      ++skipped;
+    }
+    read.clear();
+  };
+  while (std::getline(is,line)) {
+    if (!line.empty() && line.back()=='\r') line.pop_back();
+    if (line.empty()) continue;
+    if (line[0]=='>') {
+      if (fasta) add();
+      fasta = true;
+    } else if (line[0]=='@' && !fasta) {
+      // FASTQ record: header, sequence, separator and qualities
+      std::string sep, qual;
+      if (!std::getline(is,read) || !std::getline(is,sep) || !std::getline(is,qual) || sep.empty() || sep[0]!='+') {
+        throw std::runtime_error(filename + " is not properly formatted: truncated FASTQ record");
+      }
+      if (!read.empty() && read.back()=='\r') read.pop_back();
+      add();
+    } else if (fasta) {
+      read += line;
+    } else {
+      throw std::runtime_error(filename + " is not a FASTA or FASTQ file");
+    }
+  }
+  if (fasta) add();
+  return skipped;
+}
+
+
+
+//
+// Main
+//
+
+int main(int argc, char* argv[]) {
+	try {
+    args_t args = parseBwtBuildOptions(argc,argv);
+    uint64_t num_reads = 0, skipped = 0;
+    if (args.memory) {
+      // the temporary files are named after the output file
+      std::string prefix = args.outputFile + ".tmp";
+      if (!args.tmpDir.empty()) prefix = args.tmpDir + "/" + prefix.substr(prefix.find_last_of('/') + 1);
+      bwt::bcr_external_builder builder(prefix,args.memory,args.numThreads);
+      for(const auto& filename:args.readFiles) skipped += load_reads(filename,args.reverse,[&](const std::string& read) {builder.add(read);});
+      num_reads = builder.size();
+      std::cerr << "#reads:" << num_reads << " (" << skipped << " skipped)" << std::endl;
+      builder.build(args.outputFile);
+    } else {
+      std::string text;
+      for(const auto& filename:args.readFiles) {
+        skipped += load_reads(filename,args.reverse,[&](const std::string& read) {
+          text += read;
+          text.push_back(0);
+          ++num_reads;
+        });
+      }
+      std::cerr << "#reads:" << num_reads << " (" << skipped << " skipped)" << std::endl;
+      bwt::rle_string bwt;
+      if (args.appendFile.empty()) {
+        bwt = bwt::bcr_build(text,args.numThreads);
+      } else {
+        const bwt::dna_index old(bwt::read_rle_bwt(args.appendFile),args.numThreads,bwt::fm_sampling(),bwt::dna_index::PACKED_BACKEND);
+        bwt = bwt::append_strings(old,text,args.numThreads);
+      }
+      bwt.print_debug_info(std::cerr);
+      bwt::write_rle_bwt(args.outputFile,bwt);
+    }
+    std::cerr << "bwt written to " << args.outputFile << std::endl;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF,&usage);
+    std::cerr << "peak RSS:" << usage.ru_maxrss / 1024 << "Mo" << std::endl;
+	} catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+	};
+  return 0;
+}
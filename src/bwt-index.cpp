@@ -0,0 +1,123 @@
+#include <iostream>
+#include <sstream>
+#include <getopt.h>
+#include <cinttypes>
+
+#include <fm_index.h>
+#include <qmer_table.h>
+#include <suffix_array.h>
+
+
+
+typedef bwt::fm_index<5> dna_index;
+
+
+
+//
+// Getopt
+//
+struct args_t {
+  std::string bwtFile;
+  std::string indexFile;
+  unsigned numThreads = bwt::default_num_threads();
+  bwt::fm_sampling sampling;
+  unsigned qmerLength = 0;
+  unsigned saRate = 0;
+};
+
+args_t parseBwtIndexOptions(int argc, char* argv[]) {
+	static const char* usage_message =
+	"Usage: bwt-index [OPTION] src.bwt\n"
+	"Build the FM index marks of src.bwt and save them in a file that query tools map directly at startup.\n"
+	"\n"
+	"      --help                           display this help and exit\n"
+	"      -o, --output=FILE                write the index to FILE (default: src.bwt.fmi)\n"
+	"      -t, --threads=N                  number of threads used to build the index (default: number of cores)\n"
+	"      -s, --sampling=N                 symbols between the small marks, a power of two, or one of dense (32),\n"
+	"                                       default (128) and sparse (1024). Dense is faster, sparse is smaller.\n"
+	"      -q, --qmer=Q                     also save the intervals of all the DNA strings of length Q in src.bwt.qmt,\n"
+	"                                       that backward searches look up instead of searching the last Q symbols.\n"
+	"                                       The table takes 16*4^Q bytes (16MB for Q=10).\n"
+	"      -a, --sa-rate=N                  also save in src.bwt.ssa the positions in the reads of one suffix every N\n"
+	"                                       symbols of each read, that locate the rows in less than N LF steps.\n"
+	"                                       The samples take about 8/N bytes per symbol.\n";
+
+	enum { OPT_HELP = 1 };
+	static const struct option longopts[] = {
+    { "output",                required_argument, NULL, 'o' },
+    { "threads",               required_argument, NULL, 't' },
+    { "sampling",              required_argument, NULL, 's' },
+    { "qmer",                  required_argument, NULL, 'q' },
+    { "sa-rate",               required_argument, NULL, 'a' },
+    { "help",                  no_argument,       NULL, OPT_HELP },
+    { NULL, 0, NULL, 0 }
+	};
+	args_t args;
+	
+  for (char c; (c = getopt_long(argc, argv, "o:t:s:q:a:", longopts, NULL)) != -1;) {
+    std::istringstream arg(optarg != NULL ? optarg : "");
+    switch (c) {
+      case 'o': arg >> args.indexFile; break;
+      case 't': arg >> args.numThreads; break;
+      case 'q': arg >> args.qmerLength; break;
+      case 'a': arg >> args.saRate; break;
+      case 's':
+        try {
+          args.sampling = bwt::fm_sampling::parse(arg.str());
+        } catch (const std::invalid_argument& e) {
+          std::cerr << "bwt-index: " << e.what() << "\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case OPT_HELP:
+        std::cout << usage_message;
+        exit(EXIT_SUCCESS);
+    }
+  }
+
+  if (args.numThreads == 0) {
+    std::cerr << "bwt-index: invalid number of threads\n";
+    std::cout << "\n" << usage_message;
+    exit(EXIT_FAILURE);
+  }
+
+  if (argc - optind != 1) {
+    std::cerr << "bwt-index: expect exactly one bwt file\n";
+    std::cout << "\n" << usage_message;
+    exit(EXIT_FAILURE);
+  }
+  args.bwtFile = argv[optind];
+  if (args.indexFile.empty()) args.indexFile = bwt::fm_index_filename(args.bwtFile);
+  
+  return args;
+}
+
+
+
+//
+// Main
+//
+
+int main(int argc, char* argv[]) {
+	try {
+    args_t args = parseBwtIndexOptions(argc,argv);
+    dna_index fm(bwt::map_rle_bwt(args.bwtFile,false,MADV_SEQUENTIAL),args.numThreads,args.sampling);
+    fm.print_debug_info(std::cerr);
+    fm.save(args.indexFile);
+    std::cerr << "index written to " << args.indexFile << std::endl;
+    if (args.qmerLength) {
+      const std::string table_filename = bwt::qmer_table_filename(args.bwtFile);
+      bwt::qmer_table(fm,args.qmerLength,args.numThreads).save(table_filename);
+      std::cerr << "q-mer table written to " << table_filename << std::endl;
+    }
+    if (args.saRate) {
+      const std::string sa_filename = bwt::sampled_suffix_array_filename(args.bwtFile);
+      bwt::sampled_suffix_array(fm,args.saRate,args.numThreads).save(sa_filename);
+      std::cerr << "suffix array samples written to " << sa_filename << std::endl;
+    }
+	} catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+	};
+  return 0;
+}
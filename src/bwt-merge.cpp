@@ -0,0 +1,112 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <getopt.h>
+#include <cinttypes>
+
+#include <dna_index.h>
+#include <merge.h>
+
+
+
+typedef bwt::dna_index dna_index;
+
+
+
+//
+// Getopt
+//
+struct args_t {
+  std::vector<std::string> bwtFiles;
+  std::string outputFile;
+  unsigned numThreads = bwt::default_num_threads();
+  dna_index::backend_t backend = dna_index::PACKED_BACKEND;
+};
+
+args_t parseBwtMergeOptions(int argc, char* argv[]) {
+	static const char* usage_message =
+	"Usage: bwt-merge [OPTION] -o out.bwt a.bwt b.bwt [c.bwt ...]\n"
+	"Merge the BWTs of several collections of reads into the BWT of their concatenation, without sorting the suffixes\n"
+	"again: the reads of b.bwt follow the ones of a.bwt, and so on. The rows of each BWT are placed in the merged BWT\n"
+	"by walking its reads backward, the walks being done in parallel.\n"
+	"\n"
+	"      --help                           display this help and exit\n"
+	"      -o, --output=FILE                write the merged BWT to FILE\n"
+	"      -t, --threads=N                  number of threads to use (default: number of cores)\n"
+	"      --backend=NAME                   index of the BWTs: rle (run-length encoded), packed (2 bits per symbol), or\n"
+	"                                       auto to choose from the average run length. Each step of the walks is a\n"
+	"                                       random rank in two BWTs, faster with the packed index (default: packed)\n";
+
+	enum { OPT_HELP = 1, OPT_BACKEND };
+	static const struct option longopts[] = {
+    { "output",                required_argument, NULL, 'o' },
+    { "threads",               required_argument, NULL, 't' },
+    { "backend",               required_argument, NULL, OPT_BACKEND },
+    { "help",                  no_argument,       NULL, OPT_HELP },
+    { NULL, 0, NULL, 0 }
+	};
+	args_t args;
+
+  for (char c; (c = getopt_long(argc, argv, "o:t:", longopts, NULL)) != -1;) {
+    std::istringstream arg(optarg != NULL ? optarg : "");
+    try {
+      switch (c) {
+        case 'o': arg >> args.outputFile; break;
+        case 't': arg >> args.numThreads; break;
+        case OPT_BACKEND: args.backend = dna_index::parse_backend(arg.str()); break;
+        case OPT_HELP:
+          std::cout << usage_message;
+          exit(EXIT_SUCCESS);
+      }
+    } catch (const std::invalid_argument& e) {
+      std::cerr << "bwt-merge: " << e.what() << "\n";
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (args.numThreads == 0) {
+    std::cerr << "bwt-merge: invalid number of threads\n";
+    std::cout << "\n" << usage_message;
+    exit(EXIT_FAILURE);
+  }
+
+  if (args.outputFile.empty()) {
+    std::cerr << "bwt-merge: missing output file\n";
+    std::cout << "\n" << usage_message;
+    exit(EXIT_FAILURE);
+  }
+
+  for(;optind<argc;++optind) args.bwtFiles.push_back(argv[optind]);
+  if (args.bwtFiles.size() < 2) {
+    std::cerr << "bwt-merge: expect at least two bwt files\n";
+    std::cout << "\n" << usage_message;
+    exit(EXIT_FAILURE);
+  }
+
+  return args;
+}
+
+
+
+//
+// Main
+//
+
+int main(int argc, char* argv[]) {
+	try {
+    args_t args = parseBwtMergeOptions(argc,argv);
+    bwt::rle_string merged = bwt::read_rle_bwt(args.bwtFiles[0]);
+    for(size_t k=1;k<args.bwtFiles.size();++k) {
+      const dna_index a(std::move(merged),args.numThreads,bwt::fm_sampling(),args.backend);
+      const dna_index b(bwt::read_rle_bwt(args.bwtFiles[k]),args.numThreads,bwt::fm_sampling(),args.backend);
+      merged = bwt::merge_bwt(a,b,args.numThreads);
+    }
+    merged.print_debug_info(std::cerr);
+    bwt::write_rle_bwt(args.outputFile,merged);
+    std::cerr << "bwt written to " << args.outputFile << std::endl;
+	} catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+	};
+  return 0;
+}
@@ -0,0 +1,151 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <getopt.h>
+#include <cinttypes>
+
+#include <dna_index.h>
+#include <algo.h>
+
+
+
+typedef bwt::dna_index dna_index;
+const std::string alphabet("$ACGT");
+
+
+
+//
+// Getopt
+//
+struct args_t {
+  std::string bwtFile;
+  bool mmap = false;
+  bool populate = false;
+  unsigned int numThreads = bwt::default_num_threads();
+  bwt::fm_sampling sampling;
+  bool samplingGiven = false;
+  dna_index::backend_t backend = dna_index::AUTO_BACKEND;
+  bool bwtOrder = false;
+};
+
+args_t parseExtractReadsOptions(int argc, char* argv[]) {
+	static const std::string usage_message = std::string(
+	"Usage: extract-reads [OPTION] src.bwt\n"
+	"Recover the reads of src.bwt by inverting the BWT, and output them on stdout in FASTA format, each read being\n"
+	"named after its index in the collection.\n"
+	"\n"
+	"      --help                           display this help and exit\n"
+	"      -t, --threads=N                  number of threads to use (default: number of cores)\n"
+	"      --order=ORDER                    output the reads in their original order in the collection (original), or in\n"
+	"                                       the order of their '$' in the BWT (bwt), the lexicographic order of the\n"
+	"                                       reads. The bwt order reads the collection twice. (default: original)\n"
+	) + dna_index::load_usage();
+
+	enum { OPT_HELP = 1, OPT_POPULATE, OPT_BACKEND, OPT_ORDER };
+	static const struct option longopts[] = {
+    { "threads",               required_argument, NULL, 't' },
+    { "order",                 required_argument, NULL, OPT_ORDER },
+    { "sampling",              required_argument, NULL, 's' },
+    { "backend",               required_argument, NULL, OPT_BACKEND },
+    { "mmap",                  no_argument,       NULL, 'm' },
+    { "populate",              no_argument,       NULL, OPT_POPULATE },
+    { "help",                  no_argument,       NULL, OPT_HELP },
+    { NULL, 0, NULL, 0 }
+	};
+	args_t args;
+
+  for (char c; (c = getopt_long(argc, argv, "t:s:m", longopts, NULL)) != -1;) {
+    std::istringstream arg(optarg != NULL ? optarg : "");
+    try {
+      switch (c) {
+        case 't': arg >> args.numThreads; break;
+        case 's': args.sampling = bwt::fm_sampling::parse(arg.str()); args.samplingGiven = true; break;
+        case OPT_BACKEND: args.backend = dna_index::parse_backend(arg.str()); break;
+        case OPT_ORDER:
+          if (arg.str() != "original" && arg.str() != "bwt") throw std::invalid_argument("invalid order: " + arg.str());
+          args.bwtOrder = arg.str() == "bwt";
+          break;
+        case 'm': args.mmap = true; break;
+        case OPT_POPULATE: args.populate = true; break;
+        case OPT_HELP:
+          std::cout << usage_message;
+          exit(EXIT_SUCCESS);
+      }
+    } catch (const std::invalid_argument& e) {
+      std::cerr << "extract-reads: " << e.what() << "\n";
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (args.numThreads == 0) {
+    std::cerr << "extract-reads: invalid number of threads\n";
+    std::cout << "\n" << usage_message;
+    exit(EXIT_FAILURE);
+  }
+
+  if (argc - optind != 1) {
+    std::cerr << "extract-reads: expect exactly one bwt file\n";
+    std::cout << "\n" << usage_message;
+    exit(EXIT_FAILURE);
+  }
+  args.bwtFile = argv[optind];
+
+  return args;
+}
+
+
+
+//
+// Main
+//
+
+const uint64_t reads_per_chunk = 4096; // reads extracted by a thread at once
+
+int main(int argc, char* argv[]) {
+	try {
+    args_t args = parseExtractReadsOptions(argc,argv);
+    const dna_index fm = dna_index::load(args.bwtFile,args.backend,args.samplingGiven ? &args.sampling : nullptr,args.numThreads,args.mmap,args.populate);
+    const uint64_t num_strings = fm.C()[1]; // row s of the bwt is the suffix "$" of read s
+
+    // in bwt order, the i-th read is the one whose walk ends on the i-th '$' of the bwt
+    std::vector<uint64_t> reads;
+    if (args.bwtOrder) {
+      reads.resize(num_strings);
+      bwt::parallel_for((num_strings + reads_per_chunk - 1) / reads_per_chunk,args.numThreads,[&](size_t k) {
+        std::vector<uint64_t> rows, ends;
+        std::vector<std::string> strs;
+        for(uint64_t s = k * reads_per_chunk; s < std::min(num_strings,(k+1) * reads_per_chunk); ++s) rows.push_back(s);
+        bwt::extract_batch(fm,rows,strs,ends);
+        for(size_t j = 0; j < rows.size(); ++j) reads[fm.lf_step(ends[j]).second] = rows[j];
+      });
+    }
+
+    // extract the reads by rounds of a few chunks per thread, written in order at the end of each round
+    const uint64_t chunks_per_round = 8 * args.numThreads;
+    std::vector<std::string> out(chunks_per_round);
+    for(uint64_t first = 0; first < num_strings; first += chunks_per_round * reads_per_chunk) {
+      bwt::parallel_for(chunks_per_round,args.numThreads,[&](size_t k) {
+        std::vector<uint64_t> rows, ends;
+        std::vector<std::string> strs;
+        const uint64_t begin = std::min(num_strings,first + k * reads_per_chunk), end = std::min(num_strings,begin + reads_per_chunk);
+        for(uint64_t i = begin; i < end; ++i) rows.push_back(args.bwtOrder ? reads[i] : i);
+        bwt::extract_batch(fm,rows,strs,ends);
+        out[k].clear();
+        for(size_t j = 0; j < rows.size(); ++j) {
+          out[k].push_back('>');
+          out[k] += std::to_string(rows[j]);
+          out[k].push_back('\n');
+          for(auto c:strs[j]) out[k].push_back(alphabet[c]);
+          out[k].push_back('\n');
+        }
+      });
+      for(const auto& o:out) std::cout.write(o.data(),o.size());
+    }
+    std::cout.flush();
+    if (!std::cout) throw std::runtime_error("error while writing the output");
+	} catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+	};
+  return 0;
+}
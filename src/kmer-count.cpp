@@ -2,18 +2,24 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
-#include <stack>
+#include <deque>
+#include <map>
+#include <set>
 #include <memory>
 #include <getopt.h>
+#include <unistd.h>
 #include <cinttypes>
 #include <cinttypes>
 
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
 
-#include <fm_index.h>
+#include <dna_index.h>
 #include <algo.h>
+#include <kmer_table.h>
+#include <qmer_table.h>
 
 
 
@@ -26,7 +32,7 @@ inline uint8_t encode(char c) {return alphabet.find(c);}
 inline char decode(uint8_t c) {return alphabet[c];}
 inline uint8_t complement(uint8_t c) {return 5-c;}
 
-typedef bwt::fm_index<5> dna_index;
+typedef bwt::dna_index dna_index;
 typedef std::vector<dna_index> dna_indices;
 
 
@@ -37,39 +43,162 @@ typedef std::vector<dna_index> dna_indices;
 struct args_t {
   std::vector<std::string> bwtFiles;
   int kmerLength = 27;
+  bool mmap = false;
+  bool populate = false;
+  unsigned int numThreads = bwt::default_num_threads();
+  bwt::fm_sampling sampling;
+  bool samplingGiven = false;
+  dna_index::backend_t backend = dna_index::AUTO_BACKEND;
+  bool binary = false;
+  uint64_t minCount = 0;
+  uint64_t maxCount = UINT64_MAX;
+  bool histogram = false;
+  std::vector<int> histogramLengths;
+  unsigned int shardIndex = 0;
+  unsigned int numShards = 1;
+  std::string output;
+  std::string checkpoint;
 };
 
 args_t parseKmerCountOptions(int argc, char* argv[]) {
-	static const char* usage_message =
+	static const std::string usage_message = std::string(
 	"Usage: kmer-count [OPTION] src.bwt [test1.bwt] [test2.bwt]\n"
 	"Generate a table of the k-mers in src.bwt, and optionaly count the number of time they appears in testX.bwt.\n"
-	"Output on stdout the canonical kmers and their counts on forward and reverse strand\n"
+	"Output on stdout the canonical kmers and their counts on forward and reverse strand in each file, all files\n"
+	"being traversed together: a k-mer is output as soon as it appears in one of them.\n"
 	"\n"
 	"      --help                           display this help and exit\n"
 	"      --version                        display program version\n"
-	"      -k, --kmer-size=N                The length of the kmer to use. (default: 27)\n";
+	"      -k, --kmer-size=N                The length of the kmer to use. (default: 27)\n"
+	"      -t, --threads=N                  number of threads to use (default: number of cores)\n"
+	) + dna_index::load_usage() +
+	"      --min-count=N                    only output the k-mers occuring at least N times in src.bwt, both strands\n"
+	"                                       together. The traversal skips the subtrees of the rarer strings.\n"
+	"      --max-count=N                    only output the k-mers occuring at most N times in src.bwt\n"
+	"      --histogram[=K1,K2,...]          instead of the k-mers, output the number of canonical k-mers of each count in\n"
+	"                                       each file, for the k-mer length given by -k or for each of the given lengths\n"
+	"      -b, --binary                     output a binary table of 2-bit packed k-mers and varint counts, that\n"
+	"                                       kmer-decode converts back to text\n"
+	"      -o, --output=FILE                write the output to FILE instead of stdout\n"
+	"      --shard=I/N                      only traverse the I-th of N disjoint parts of the k-mers, I in [0,N). The\n"
+	"                                       k-mers are partitioned by their last symbols: the outputs of the N shards\n"
+	"                                       together are the output of the whole traversal, and their histograms add up\n"
+	"      --checkpoint=FILE                with --output, record in FILE the parts of the traversal completed, and\n"
+	"                                       resume from them when FILE exists\n"
+	"\n"
+	"When the bwt of the reversed reads of X.bwt exists as X.rbwt, it is used to count the reverse complements of\n"
+	"X.bwt during the traversal instead of searching them again. Otherwise, the searches start from the q-mer table\n"
+	"X.bwt.qmt built by bwt-index -q when it exists.\n";
 
-	enum { OPT_HELP = 1 };
+	enum { OPT_HELP = 1, OPT_POPULATE, OPT_BACKEND, OPT_MIN_COUNT, OPT_MAX_COUNT, OPT_HISTOGRAM, OPT_SHARD, OPT_CHECKPOINT };
 	static const struct option longopts[] = {
     { "kmer-size",             required_argument, NULL, 'k' },
+    { "threads",               required_argument, NULL, 't' },
+    { "sampling",              required_argument, NULL, 's' },
+    { "binary",                no_argument,       NULL, 'b' },
+    { "min-count",             required_argument, NULL, OPT_MIN_COUNT },
+    { "max-count",             required_argument, NULL, OPT_MAX_COUNT },
+    { "histogram",             optional_argument, NULL, OPT_HISTOGRAM },
+    { "output",                required_argument, NULL, 'o' },
+    { "shard",                 required_argument, NULL, OPT_SHARD },
+    { "checkpoint",            required_argument, NULL, OPT_CHECKPOINT },
+    { "mmap",                  no_argument,       NULL, 'm' },
+    { "populate",              no_argument,       NULL, OPT_POPULATE },
+    { "backend",               required_argument, NULL, OPT_BACKEND },
     { "help",                  no_argument,       NULL, OPT_HELP },
     { NULL, 0, NULL, 0 }
 	};
 	args_t args;
 	
 
-  for (char c; (c = getopt_long(argc, argv, "d:k:x:", longopts, NULL)) != -1;) {
+  for (char c; (c = getopt_long(argc, argv, "d:k:x:mbt:s:o:", longopts, NULL)) != -1;) {
     std::istringstream arg(optarg != NULL ? optarg : "");
     switch (c) {
       case 'k': arg >> args.kmerLength; break;
+      case 't': arg >> args.numThreads; break;
+      case 's':
+        try {
+          args.sampling = bwt::fm_sampling::parse(arg.str());
+          args.samplingGiven = true;
+        } catch (const std::invalid_argument& e) {
+          std::cerr << "kmer-count: " << e.what() << "\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'b': args.binary = true; break;
+      case OPT_MIN_COUNT: arg >> args.minCount; break;
+      case OPT_MAX_COUNT: arg >> args.maxCount; break;
+      case OPT_HISTOGRAM:
+        args.histogram = true;
+        for(std::string k; std::getline(arg,k,',');) args.histogramLengths.push_back(std::atoi(k.c_str()));
+        break;
+      case 'o': args.output = arg.str(); break;
+      case OPT_SHARD: {
+        char sep = 0;
+        arg >> args.shardIndex >> sep >> args.numShards;
+        if (!arg || sep != '/' || args.numShards == 0 || args.shardIndex >= args.numShards) {
+          std::cerr << "kmer-count: invalid shard: " << arg.str() << ", must be I/N with 0<=I<N\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case OPT_CHECKPOINT: args.checkpoint = arg.str(); break;
+      case 'm': args.mmap = true; break;
+      case OPT_POPULATE: args.populate = true; break;
+      case OPT_BACKEND:
+        try {
+          args.backend = dna_index::parse_backend(arg.str());
+        } catch (const std::invalid_argument& e) {
+          std::cerr << "kmer-count: " << e.what() << "\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
       case OPT_HELP:
         std::cout << usage_message;
         exit(EXIT_SUCCESS);
     }
   }
 
-  if(args.kmerLength <= 0 || args.kmerLength % 2 == 0) {
-    std::cerr << "kmer-count: invalid kmer length: " << args.kmerLength << ", must be greater than zero and odd\n";
+  // the traversal goes down to the longest kmers of the histograms
+  if (args.histogram && args.histogramLengths.empty()) args.histogramLengths.push_back(args.kmerLength);
+  if (!args.histogramLengths.empty()) args.kmerLength = *std::max_element(args.histogramLengths.begin(),args.histogramLengths.end());
+  
+  args.histogramLengths.push_back(args.kmerLength);
+  for(int k:args.histogramLengths) {
+    if(k <= 0 || k % 2 == 0) {
+      std::cerr << "kmer-count: invalid kmer length: " << k << ", must be greater than zero and odd\n";
+      std::cout << "\n" << usage_message;
+      exit(EXIT_FAILURE);
+    }
+  }
+  args.histogramLengths.pop_back();
+
+  if (args.histogram && args.binary) {
+    std::cerr << "kmer-count: --histogram and --binary cannot be used together\n";
+    std::cout << "\n" << usage_message;
+    exit(EXIT_FAILURE);
+  }
+
+  if (!args.checkpoint.empty() && args.output.empty()) {
+    std::cerr << "kmer-count: --checkpoint requires --output\n";
+    std::cout << "\n" << usage_message;
+    exit(EXIT_FAILURE);
+  }
+
+  if (!args.checkpoint.empty() && args.histogram) {
+    std::cerr << "kmer-count: --histogram and --checkpoint cannot be used together\n";
+    std::cout << "\n" << usage_message;
+    exit(EXIT_FAILURE);
+  }
+
+  if (args.minCount > args.maxCount) {
+    std::cerr << "kmer-count: invalid count range: " << args.minCount << "-" << args.maxCount << "\n";
+    std::cout << "\n" << usage_message;
+    exit(EXIT_FAILURE);
+  }
+
+  if (args.numThreads == 0) {
+    std::cerr << "kmer-count: invalid number of threads\n";
     std::cout << "\n" << usage_message;
     exit(EXIT_FAILURE);
   }
@@ -93,81 +222,250 @@ args_t parseKmerCountOptions(int argc, char* argv[]) {
 // BWT Traversal algorithm
 //
 
+// Intervals of the path in the bwt of one file
+struct sample_node_t {
+  dna_index::alpha_count64 lb;
+  dna_index::alpha_count64 ub;
+  std::array<bwt::bi_interval,5> rc; // with a reverse index, rc[c] is the bi-interval of the reverse complement of the path followed by c
+};
+
 // Stack structure used in the depth first search of kmers
 struct stack_elt_t {
   dna_string path;
-  dna_index::alpha_count64 lb;
-  dna_index::alpha_count64 ub;
+  std::vector<sample_node_t> samples; // one per bwt file, all extended in lock-step
+};
+
+
+
+// Work queue of one thread: the owner pushes and pops nodes at the back (depth-first),
+// the other threads steal at the front, where the shallowest nodes, with the largest subtrees, are
+struct work_queue_t {
+  std::mutex mtx;
+  std::deque< stack_elt_t > nodes;
 };
 
 
 
 dna_indices bwts;
-std::stack< stack_elt_t > stack;
-std::mutex mtx,io_mtx;
-std::condition_variable cv;
-unsigned int num_working_thread = 0;
+std::vector< std::unique_ptr<dna_index> > rbwts; // bwt of the reversed collection of each file, when available
+std::vector< std::unique_ptr<bwt::qmer_table> > qmers; // q-mer table of each file, when available
+std::vector< std::unique_ptr<work_queue_t> > queues;
+std::atomic<uint64_t> num_pending_nodes(0); // nodes queued or being processed
+std::atomic<uint64_t> num_queued_nodes(0);  // nodes queued
+std::atomic<unsigned> num_idle_threads(0);  // threads waiting for a node to be queued
+std::mutex idle_mtx;
+std::condition_variable idle_cv;            // notified when a node is queued, and at the end of the traversal
+std::mutex io_mtx;
+std::ostream* output = &std::cout;
+uint64_t output_bytes = 0; // bytes written to the output
+bool binary_output = false;
+uint64_t min_count = 0, max_count = UINT64_MAX; // range of the canonical counts in the source of the output kmers
+const size_t output_block_size = 1<<20; // threads buffer their output and write it by blocks of this size
+
+
+// Number of canonical kmers of each count
+struct histogram_t {
+  std::vector<uint64_t> dense = std::vector<uint64_t>(1024,0); // counts below 1024
+  std::map<uint64_t,uint64_t> sparse;                           // larger counts
+  inline void add(uint64_t count, uint64_t n = 1) {
+    if (count < dense.size()) dense[count] += n; else sparse[count] += n;
+  }
+  void merge(const histogram_t& h) {
+    for(size_t c = 0; c < h.dense.size(); ++c) dense[c] += h.dense[c];
+    for(const auto& x:h.sparse) sparse[x.first] += x.second;
+  }
+};
 
+bool histogram_mode = false;
+std::vector<int> histogram_slots; // histogram_slots[d] is the index of the histograms of the kmers of length d, or -1
+std::vector< std::vector<histogram_t> > histograms; // per thread, the histograms of each length for each bwt
 
-// extract all canonical kmers of a bwt by performing a backward depth-first-search
-void traverse_kmer(unsigned int k) {
-	{
-		std::unique_lock<std::mutex> lck(mtx);
-		++num_working_thread;
-	}
-	
+
+// push a node in the queue of the given thread
+inline void push_node(unsigned int id, const stack_elt_t& e) {
+  ++num_pending_nodes;
+  {
+    std::unique_lock<std::mutex> lck(queues[id]->mtx);
+    queues[id]->nodes.push_back(e);
+  }
+  ++num_queued_nodes;
+  if (num_idle_threads > 0) {
+    std::unique_lock<std::mutex> lck(idle_mtx);
+    idle_cv.notify_one();
+  }
+}
+
+// a node has been processed, the idle threads are woken up to exit once none is left
+inline void done_node() {
+  if (--num_pending_nodes == 0) {
+    std::unique_lock<std::mutex> lck(idle_mtx);
+    idle_cv.notify_all();
+  }
+}
+
+// wait for a node to be queued, or for the end of the traversal
+void wait_node() {
+  std::unique_lock<std::mutex> lck(idle_mtx);
+  ++num_idle_threads;
+  idle_cv.wait(lck,[]() {return num_queued_nodes > 0 || num_pending_nodes == 0;});
+  --num_idle_threads;
+}
+
+// pop a node from the back of the thread's own queue, or steal one at the front of another queue
+bool pop_node(unsigned int id, stack_elt_t& e) {
+  {
+    work_queue_t& q = *queues[id];
+    std::unique_lock<std::mutex> lck(q.mtx);
+    if (!q.nodes.empty()) {
+      e = std::move(q.nodes.back());
+      q.nodes.pop_back();
+      --num_queued_nodes;
+      return true;
+    }
+  }
+  for(size_t j = 1; j < queues.size(); ++j) {
+    work_queue_t& q = *queues[(id + j) % queues.size()];
+    std::unique_lock<std::mutex> lck(q.mtx);
+    if (!q.nodes.empty()) {
+      e = std::move(q.nodes.front());
+      q.nodes.pop_front();
+      --num_queued_nodes;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+// count the occurences of string s in an index by backward search, starting from its last q-mer when a table is given
+uint64_t count_occurences(const dna_index& fm, const bwt::qmer_table* table, const dna_string& s) {
+  const auto r = table ? bwt::backward_search(fm,*table,s.begin(),s.end()) : bwt::backward_search(fm,s.begin(),s.end());
+  return r.second>r.first?r.second-r.first:0;
+}
+
+
+// write the output buffer of a thread to stdout
+void flush_output(std::string& out) {
+  std::unique_lock<std::mutex> lck(io_mtx);
+  output->write(out.data(),out.size());
+  output_bytes += out.size();
+  out.clear();
+}
+
+// append the decimal representation of v to out
+inline void append_count(std::string& out, uint64_t v) {
+  char buf[20];
+  char* p = buf + sizeof(buf);
+  do {*--p = '0' + v % 10;} while (v /= 10);
+  out.append(p,buf + sizeof(buf));
+}
+
+
+// child of a node: its path extended on the left by symbol c in all the bwts
+stack_elt_t extend_node(const stack_elt_t& top, uint8_t c) {
+  stack_elt_t e = top;
+  e.path.push_back(c);
+  for(size_t s = 0; s < bwts.size(); ++s) {
+    auto& x = e.samples[s];
+    bwt::extend_lhs(bwts[s],x.lb,x.ub,c);
+    if (rbwts[s]) bwt::extend_rhs(*rbwts[s],x.rc,top.samples[s].rc[complement(c)]);
+  }
+  return e;
+}
+
+
+// extract all canonical kmers of the bwts by performing a backward depth-first-search of all of them together
+void traverse_kmer(unsigned int k, unsigned int id) {
+	stack_elt_t top;
+	std::vector<uint64_t> fwd_counts(bwts.size()), rev_counts(bwts.size());
+	std::string out;
+	out.reserve(output_block_size + 1024);
 	while(true) {
-		stack_elt_t top;
-		{// pop one element from the stack
-	    std::unique_lock<std::mutex> lck(mtx);
-	    --num_working_thread;
-	    while (stack.empty() && num_working_thread>0) cv.wait(lck);
-	    if (stack.empty()) break;
-	    ++num_working_thread;
-	    top = stack.top();
-	    stack.pop();
+		if (!pop_node(id,top)) {
+			// no work left anywhere: the traversal is over once no other thread can produce new nodes
+			if (num_pending_nodes == 0) break;
+			wait_node();
+			continue;
 		}
     
     for(size_t i = 1; i < alphabet.size(); ++i) {
-  		if (top.lb[i]<top.ub[i]) {
-        stack_elt_t e = top;
-        e.path.push_back(i);
-        if (e.path.length()>=k) {
-        	// extract forward an reverse sequence from the path
-					std::string fwd(e.path);
-					std::reverse(fwd.begin(),fwd.end());
-					std::string rev(e.path);
-					std::transform(rev.begin(),rev.end(),rev.begin(),complement);
-					
-					// count number of occurence of the reverse complement
-					dna_index::alpha_count64 lb,ub;
-					alpha_range(bwts[0],lb,ub);
-					for(size_t i=rev.size()-1;i>1;--i) bwt::extend_lhs(bwts[0],lb,ub,rev[i]);
-					uint64_t rev_count = ub[rev.front()]>lb[rev.front()]?ub[rev.front()]-lb[rev.front()]:0;
-					
-					// 
-					uint64_t fwd_count = e.ub[i]>e.lb[i]?e.ub[i]-e.lb[i]:0;
-					
-					// output the counts 
-          if (fwd<=rev) {
-          	std::transform(fwd.begin(),fwd.end(),fwd.begin(),decode);
-						std::unique_lock<std::mutex> lck(io_mtx);
-						std::cout << fwd << '\t' << fwd_count << '\t' << rev_count << std::endl;
+      // a subtree is pruned only when its path is absent from all the bwts
+      bool found = false;
+      for(const auto& x:top.samples) found |= x.lb[i]<x.ub[i];
+      if (!found) continue;
+      
+      // a longer string never occurs more often: a subtree is also pruned as soon as the canonical count
+      // of its path in the source is below the minimum count
+      if (min_count > 1) {
+        const auto& x = top.samples[0];
+        uint64_t count = x.ub[i]>x.lb[i]?x.ub[i]-x.lb[i]:0;
+        if (count < min_count) {
+          if (rbwts[0]) {
+            count += x.rc[complement(i)].size;
+          } else {
+            std::string rev(top.path);
+            rev.push_back(i);
+            std::transform(rev.begin(),rev.end(),rev.begin(),complement);
+            count += count_occurences(bwts[0],qmers[0].get(),rev);
+          }
+        }
+        if (count < min_count) continue;
+      }
+      
+      const size_t depth = top.path.length()+1;
+      if (depth>=k || (histogram_mode && histogram_slots[depth]>=0)) {
+        // extract forward an reverse sequence from the path
+        std::string fwd(top.path);
+        fwd.push_back(i);
+        std::string rev(fwd);
+        std::reverse(fwd.begin(),fwd.end());
+        std::transform(rev.begin(),rev.end(),rev.begin(),complement);
+        
+        // count number of occurence of the kmer and of its reverse complement in each bwt
+        uint64_t rev_total = 0;
+        for(size_t s = 0; s < bwts.size(); ++s) {
+          const auto& x = top.samples[s];
+          fwd_counts[s] = x.ub[i]>x.lb[i]?x.ub[i]-x.lb[i]:0;
+          rev_counts[s] = rbwts[s] ? x.rc[complement(i)].size : count_occurences(bwts[s],qmers[s].get(),rev);
+          rev_total += rev_counts[s];
+        }
+        
+        // output the counts, or add them to the histograms. A canonical kmer whose both strands occur
+        // is output from the traversal of its own strand
+        const uint64_t count = fwd_counts[0] + rev_counts[0];
+        if ((fwd<=rev || rev_total==0) && count >= min_count && count <= max_count) {
+          const bool own = fwd<=rev;
+          std::string& kmer = own ? fwd : rev;
+          if (histogram_mode) {
+            for(size_t s = 0; s < bwts.size(); ++s) {
+              if (fwd_counts[s] + rev_counts[s]) histograms[id][histogram_slots[depth] * bwts.size() + s].add(fwd_counts[s] + rev_counts[s]);
+            }
+          } else if (binary_output) {
+            std::transform(kmer.begin(),kmer.end(),kmer.begin(),[](char c) {return c-1;});
+            bwt::append_packed_kmer(out,kmer);
+            for(size_t s = 0; s < bwts.size(); ++s) {
+              bwt::append_varint(out,own ? fwd_counts[s] : rev_counts[s]);
+              bwt::append_varint(out,own ? rev_counts[s] : fwd_counts[s]);
+            }
           } else {
-          	std::transform(rev.begin(),rev.end(),rev.begin(),decode);
-						std::unique_lock<std::mutex> lck(io_mtx);
-						std::cout << rev << '\t' << rev_count << '\t' << fwd_count << std::endl;          	
+            std::transform(kmer.begin(),kmer.end(),kmer.begin(),decode);
+            out += kmer;
+            for(size_t s = 0; s < bwts.size(); ++s) {
+              out.push_back('\t');
+              append_count(out,own ? fwd_counts[s] : rev_counts[s]);
+              out.push_back('\t');
+              append_count(out,own ? rev_counts[s] : fwd_counts[s]);
+            }
+            out.push_back('\n');
           }
-        } else {
-          bwt::extend_lhs(bwts[0],e.lb,e.ub,i);
-          std::unique_lock<std::mutex> lck(mtx);
-          stack.push(e);
-          cv.notify_one();
+          if (out.size() >= output_block_size) flush_output(out);
         }
-  		}
+      }
+      if (depth<k) push_node(id,extend_node(top,i));
     }
+    done_node();
 	}
-	cv.notify_all();
+	flush_output(out);
 }
 
 
@@ -176,27 +474,182 @@ void traverse_kmer(unsigned int k) {
 // Main
 //
 
+// SGA stores the bwt of the reversed reads of X.bwt in X.rbwt
+std::string reverse_bwt_filename(const std::string& filename) {
+  const std::string ext(".bwt");
+  if (filename.size() <= ext.size() || filename.compare(filename.size()-ext.size(),ext.size(),ext) != 0) return std::string();
+  return filename.substr(0,filename.size()-ext.size()) + ".rbwt";
+}
+
+// The traversal is split into the subtrees of the paths of prefix_length() symbols, the last symbols of the kmers.
+// Shard I of N traverses the subtrees of rank I modulo N one after the other, so that the end of each subtree
+// can be recorded in the checkpoint along with the size of the output at this point.
+
+// number of symbols of the paths splitting the traversal: enough for about 16 subtrees per shard,
+// the shortest output kmers being below the roots of the subtrees
+unsigned int prefix_length(const args_t& args) {
+  if (args.numShards == 1 && args.checkpoint.empty()) return 0;
+  int shortest = args.kmerLength;
+  for(int k:args.histogramLengths) shortest = std::min(shortest,k);
+  unsigned int p = 0;
+  for(uint64_t n = 1; n < 16 * (uint64_t) args.numShards; n *= 4) ++p;
+  return std::min<unsigned int>(p,shortest - 1);
+}
+
+// first line of a checkpoint, identifying the run that wrote it
+std::string checkpoint_signature(const args_t& args) {
+  std::ostringstream os;
+  os << "kmer-count checkpoint k=" << args.kmerLength << " shard=" << args.shardIndex << '/' << args.numShards
+     << " prefix=" << prefix_length(args) << " binary=" << args.binary << " min-count=" << args.minCount << " max-count=" << args.maxCount;
+  for(const auto& filename:args.bwtFiles) os << ' ' << filename;
+  return os.str();
+}
+
+// read the subtrees completed by a previous run and the size of the output at the end of the last one
+// \return false when the checkpoint doesn't exist or doesn't record any completed subtree
+bool read_checkpoint(const args_t& args, std::set<std::string>& completed, uint64_t& bytes) {
+  std::ifstream is(args.checkpoint);
+  std::string line;
+  if (!std::getline(is,line)) return false;
+  if (line != checkpoint_signature(args)) throw std::runtime_error(args.checkpoint + " has been written by a run with other options or files");
+  while (std::getline(is,line) && !is.eof()) { // the last line is incomplete when the run has been stopped while writing it
+    std::istringstream ls(line);
+    std::string suffix;
+    if (!(std::getline(ls,suffix,'\t') >> bytes)) throw std::runtime_error(args.checkpoint + " is not properly formatted");
+    completed.insert(suffix);
+  }
+  return !completed.empty();
+}
+
 int main(int argc, char* argv[]) {
 	try {
     // parse command line arguments
     args_t args = parseKmerCountOptions(argc,argv);
 		
-		// load bwt from files
+    // load bwt from files, the reverse index of a file makes its reverse complement counts incremental
     for(const auto& filename:args.bwtFiles) {
-      bwts.push_back(dna_index(bwt::read_rle_bwt(filename)));
+      bwts.push_back(dna_index::load(filename,args.backend,args.samplingGiven ? &args.sampling : nullptr,args.numThreads,args.mmap,args.populate));
+      rbwts.emplace_back();
+      qmers.emplace_back();
+      const std::string table_filename = bwt::qmer_table_filename(filename);
+      if (std::ifstream(table_filename)) {
+        std::cerr << "loading q-mer table " << table_filename << std::endl;
+        qmers.back().reset(new bwt::qmer_table(bwts.back(),table_filename,args.populate));
+      }
+      const std::string rbwt_filename = reverse_bwt_filename(filename);
+      if (!rbwt_filename.empty() && std::ifstream(rbwt_filename)) {
+        rbwts.back().reset(new dna_index(dna_index::load(rbwt_filename,args.backend,args.samplingGiven ? &args.sampling : nullptr,args.numThreads,args.mmap,args.populate)));
+        if (rbwts.back()->bwt().size() != bwts.back().bwt().size()) throw std::runtime_error(rbwt_filename + " doesn't match " + filename);
+      }
+    }
+    
+    // a resumed run appends to the output of the subtrees completed by the previous runs,
+    // the output of the subtree they were traversing being discarded
+    std::set<std::string> completed;
+    const bool resume = !args.checkpoint.empty() && read_checkpoint(args,completed,output_bytes);
+    std::ofstream output_file, checkpoint_file;
+    if (!args.output.empty()) {
+      if (resume) {
+        if ((uint64_t) std::ifstream(args.output,std::ios::binary|std::ios::ate).tellg() < output_bytes || truncate(args.output.c_str(),output_bytes) != 0) {
+          throw std::runtime_error(args.output + " is shorter than recorded in " + args.checkpoint);
+        }
+        output_file.open(args.output,std::ios::binary|std::ios::app);
+      } else {
+        output_file.open(args.output,std::ios::binary|std::ios::trunc);
+      }
+      if (!output_file) throw std::runtime_error("unable to create " + args.output);
+      output = &output_file;
+    }
+    if (!args.checkpoint.empty()) {
+      checkpoint_file.open(args.checkpoint,resume ? std::ios::app : std::ios::trunc);
+      if (!resume) checkpoint_file << checkpoint_signature(args) << std::endl;
+      if (!checkpoint_file) throw std::runtime_error("unable to create " + args.checkpoint);
+      if (resume) std::cerr << "resuming after " << completed.size() << " completed subtrees" << std::endl;
+    }
+    
+    // the binary table starts with its header
+    binary_output = args.binary;
+    min_count = args.minCount;
+    max_count = args.maxCount;
+    
+    // histograms of each thread for each requested length
+    histogram_mode = args.histogram;
+    histogram_slots.assign(args.kmerLength+1,-1);
+    for(size_t j = 0; j < args.histogramLengths.size(); ++j) histogram_slots[args.histogramLengths[j]] = j;
+    histograms.assign(args.numThreads,std::vector<histogram_t>(histogram_mode ? args.histogramLengths.size() * bwts.size() : 0));
+    if (binary_output && !resume) {
+      bwt::kmer_table_header h;
+      std::memset(&h,0,sizeof(h));
+      h.magic_number = bwt::kmer_table_header::magic;
+      h.version = bwt::kmer_table_header::current_version;
+      h.kmer_length = args.kmerLength;
+      h.num_files = bwts.size();
+      std::string header(reinterpret_cast<const char*>(&h),sizeof(h));
+      flush_output(header);
     }
     
     // intialize kmer traversal
-		stack.push(stack_elt_t());
-		bwt::alpha_range(bwts[0],stack.top().lb,stack.top().ub);
-		
-		// launch the threads and wait for the end
-    std::vector<std::thread> threads;
-    for(auto i:{0,1,2,3}) threads.push_back(std::thread(traverse_kmer,args.kmerLength));
-    for(auto& t:threads) t.join();
+    for(unsigned int i = 0; i < args.numThreads; ++i) queues.emplace_back(new work_queue_t);
+    stack_elt_t root;
+    root.samples.resize(bwts.size());
+    for(size_t s = 0; s < bwts.size(); ++s) {
+      bwt::alpha_range(bwts[s],root.samples[s].lb,root.samples[s].ub);
+      if (rbwts[s]) bwt::extend_rhs(*rbwts[s],root.samples[s].rc,bwt::full_range(*rbwts[s]));
+    }
+    
+    // traverse the subtrees of the shard one after the other
+    const unsigned int p = prefix_length(args);
+    const uint64_t sigma = alphabet.size() - 1;
+    uint64_t num_subtrees = 1;
+    for(unsigned int j = 0; j < p; ++j) num_subtrees *= sigma;
+    for(uint64_t r = args.shardIndex; r < num_subtrees; r += args.numShards) {
+      // the digits of r in base 4 are the path of the root of the subtree
+      stack_elt_t node(root);
+      for(uint64_t w = num_subtrees / sigma; node.path.size() < p; w /= sigma) node = extend_node(node,(r / w) % sigma + 1);
+      std::string suffix(node.path.rbegin(),node.path.rend());
+      std::transform(suffix.begin(),suffix.end(),suffix.begin(),decode);
+      if (completed.count(suffix)) continue;
+      push_node(0,node);
+      
+      // launch the threads and wait for the end
+      std::vector<std::thread> threads;
+      for(unsigned int i = 0; i < args.numThreads; ++i) threads.push_back(std::thread(traverse_kmer,args.kmerLength,i));
+      for(auto& t:threads) t.join();
+      
+      if (checkpoint_file.is_open()) {
+        output->flush();
+        if (!*output) throw std::runtime_error("error while writing the output");
+        checkpoint_file << suffix << '\t' << output_bytes << std::endl;
+        if (!checkpoint_file) throw std::runtime_error("error while writing " + args.checkpoint);
+      }
+    }
+    
+    // merge the histograms of the threads, and output a line per length and count: k, count, number of kmers in each bwt
+    if (histogram_mode) {
+      std::vector<int> lengths(args.histogramLengths);
+      std::sort(lengths.begin(),lengths.end());
+      lengths.erase(std::unique(lengths.begin(),lengths.end()),lengths.end());
+      for(int k:lengths) {
+        std::vector<histogram_t> h(bwts.size());
+        std::map<uint64_t, std::vector<uint64_t> > rows;
+        for(size_t s = 0; s < bwts.size(); ++s) {
+          for(const auto& th:histograms) h[s].merge(th[histogram_slots[k] * bwts.size() + s]);
+          for(size_t c = 0; c < h[s].dense.size(); ++c) if (h[s].dense[c]) rows[c].resize(bwts.size()),rows[c][s] = h[s].dense[c];
+          for(const auto& x:h[s].sparse) rows[x.first].resize(bwts.size()),rows[x.first][s] = x.second;
+        }
+        for(const auto& r:rows) {
+          *output << k << '\t' << r.first;
+          for(auto n:r.second) *output << '\t' << n;
+          *output << '\n';
+        }
+      }
+    }
+    output->flush();
+    if (!*output) throw std::runtime_error("error while writing the output");
     
-	} catch (std::exception e) {
+	} catch (const std::exception& e) {
 			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
 	};
   return 0;
 }
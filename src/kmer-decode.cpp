@@ -0,0 +1,78 @@
+#include <iostream>
+#include <sstream>
+#include <getopt.h>
+#include <cinttypes>
+
+#include <kmer_table.h>
+
+
+
+//
+// Getopt
+//
+struct args_t {
+  std::string tableFile;
+};
+
+args_t parseKmerDecodeOptions(int argc, char* argv[]) {
+	static const char* usage_message =
+	"Usage: kmer-decode [OPTION] table.bin\n"
+	"Convert a binary k-mer table written by kmer-count --binary to the text output of kmer-count.\n"
+	"\n"
+	"      --help                           display this help and exit\n";
+
+	enum { OPT_HELP = 1 };
+	static const struct option longopts[] = {
+    { "help",                  no_argument,       NULL, OPT_HELP },
+    { NULL, 0, NULL, 0 }
+	};
+	args_t args;
+	
+  for (char c; (c = getopt_long(argc, argv, "", longopts, NULL)) != -1;) {
+    switch (c) {
+      case OPT_HELP:
+        std::cout << usage_message;
+        exit(EXIT_SUCCESS);
+    }
+  }
+
+  if (argc - optind != 1) {
+    std::cerr << "kmer-decode: expect exactly one k-mer table\n";
+    std::cout << "\n" << usage_message;
+    exit(EXIT_FAILURE);
+  }
+  args.tableFile = argv[optind];
+  
+  return args;
+}
+
+
+
+//
+// Main
+//
+
+int main(int argc, char* argv[]) {
+	try {
+    args_t args = parseKmerDecodeOptions(argc,argv);
+    bwt::kmer_table_reader table(args.tableFile);
+    std::string kmer, line;
+    std::vector<uint64_t> counts;
+    while(table.next(kmer,counts)) {
+      line.clear();
+      for(auto b:kmer) line.push_back("ACGT"[uint8_t(b)]);
+      for(auto c:counts) {
+        line.push_back('\t');
+        line += std::to_string(c);
+      }
+      line.push_back('\n');
+      std::cout << line;
+    }
+    std::cout.flush();
+    if (!std::cout) throw std::runtime_error("error while writing the output");
+	} catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+	};
+  return 0;
+}
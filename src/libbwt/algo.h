@@ -1,6 +1,9 @@
 #ifndef ALGO_H
 #define ALGO_H
 
+#include <tuple>
+#include <string>
+#include <vector>
 #include "fm_index.h"
 
 namespace bwt {
@@ -8,8 +11,8 @@ namespace bwt {
 		/*! \brief initialize the intervals [low[c],high[c]) with the 1-character string "c"
 		 *         for each character of the alphabet
      */
-    template<size_t sz>
-    inline void alpha_range(const fm_index<sz>& fm, typename fm_index<sz>::alpha_count64& low, typename fm_index<sz>::alpha_count64& high) {				
+    template<typename Index>
+    inline void alpha_range(const Index& fm, typename Index::alpha_count64& low, typename Index::alpha_count64& high) {				
       low = fm.C();
       std::copy(low.begin()+1,low.end(),high.begin());
       high.back() = fm.bwt().size();
@@ -19,16 +22,21 @@ namespace bwt {
      *         Extension is done with all characters of the alphabet.
      *         Bounds of the extended intervals are set in [low[c],high[c])
      */
-    template<size_t sz>
-    inline void extend_lhs(const fm_index<sz>& fm, typename fm_index<sz>::alpha_count64& low, typename fm_index<sz>::alpha_count64& high, uint64_t first, uint64_t last) {
+    template<typename Index>
+    inline void extend_lhs(const Index& fm, typename Index::alpha_count64& low, typename Index::alpha_count64& high, uint64_t first, uint64_t last) {
       if (first>=last) {
       	std::fill(low.begin(),low.end(),first);
       	std::fill(high.begin(),high.end(),last);
       } else {
-				//NOTE: computation of occ(.,last) might be faster using occ(.,first)
 				low = high = fm.C();
-				if (first>0) std::transform(low.begin(),low.end(),fm.occ(first-1).begin(),low.begin(),std::plus<uint64_t>());
-				std::transform(high.begin(),high.end(),fm.occ(last-1).begin(),high.begin(),std::plus<uint64_t>());
+				if (first>0) {
+					// both bounds are computed in a single scan of the runs when they are close
+					auto n = fm.occ_pair(first-1,last-1);
+					std::transform(low.begin(),low.end(),n.first.begin(),low.begin(),std::plus<uint64_t>());
+					std::transform(high.begin(),high.end(),n.second.begin(),high.begin(),std::plus<uint64_t>());
+				} else {
+					std::transform(high.begin(),high.end(),fm.occ(last-1).begin(),high.begin(),std::plus<uint64_t>());
+				}
       }
     }
     
@@ -36,10 +44,172 @@ namespace bwt {
      *         Extension is done with all characters of the alphabet.
      *         Bounds of the extended intervals are set in [low[c],high[c])
      */
-    template<size_t sz>
-    inline void extend_lhs(const fm_index<sz>& fm, typename fm_index<sz>::alpha_count64& low,typename fm_index<sz>::alpha_count64& high, uint8_t b) {
+    template<typename Index>
+    inline void extend_lhs(const Index& fm, typename Index::alpha_count64& low,typename Index::alpha_count64& high, uint8_t b) {
       extend_lhs(fm,low,high,low[b],high[b]);
     }
+    
+    /*! \brief backward search of the string of symbols [first,last), starting from the interval [range.first,range.second)
+     *         of the string following it
+     *  \return the interval of the whole string, empty when it doesn't occur
+     */
+    template<typename Index, typename Iterator>
+    inline std::pair<uint64_t,uint64_t> backward_search(const Index& fm, Iterator first, Iterator last, std::pair<uint64_t,uint64_t> range) {
+      typename Index::alpha_count64 low,high;
+      while (last != first && range.first < range.second) {
+        --last;
+        extend_lhs(fm,low,high,range.first,range.second);
+        range = std::make_pair(low[*last],high[*last]);
+      }
+      return range;
+    }
+    
+    /*! \brief backward search of the string of symbols [first,last)
+     *  \return the interval of the string, empty when it doesn't occur
+     */
+    template<typename Index, typename Iterator>
+    inline std::pair<uint64_t,uint64_t> backward_search(const Index& fm, Iterator first, Iterator last) {
+      return backward_search(fm,first,last,std::make_pair(uint64_t(0),uint64_t(fm.bwt().size())));
+    }
+    
+    /*! \brief backward searches of a batch of strings, extended one symbol at a time in lock-step
+     *         The marks needed by the next extension of a search are prefetched as soon as it is extended, and its runs
+     *         at the begining of the next step, so that the memory accesses of the batch overlap instead of stalling
+     *         each search in turn.
+     *  \param patterns    strings of symbols, random access containers
+     *  \param ranges      set to the interval of each string, empty when it doesn't occur
+     *  \param batch_size  number of searches extended together, large enough to cover the memory latency
+     */
+    template<typename Index, typename Pattern>
+    void backward_search_batch(const Index& fm, const std::vector<Pattern>& patterns, std::vector< std::pair<uint64_t,uint64_t> >& ranges, size_t batch_size = 32) {
+      ranges.assign(patterns.size(),std::make_pair(uint64_t(0),uint64_t(fm.bwt().size())));
+      if (fm.bwt().size()==0) return;
+      typename Index::alpha_count64 low,high;
+      std::vector<size_t> active, remaining(patterns.size());
+      for(size_t b=0;b<patterns.size();b+=batch_size) {
+        active.clear();
+        for(size_t j=b;j<std::min(patterns.size(),b+batch_size);++j) {
+          remaining[j] = patterns[j].size();
+          if (remaining[j]) active.push_back(j);
+        }
+        while (!active.empty()) {
+          for(auto j:active) {
+            if (ranges[j].first>0) fm.prefetch_runs(ranges[j].first-1);
+            fm.prefetch_runs(ranges[j].second-1);
+          }
+          size_t k = 0;
+          for(auto j:active) {
+            auto& r = ranges[j];
+            const auto c = patterns[j][--remaining[j]];
+            extend_lhs(fm,low,high,r.first,r.second);
+            r = std::make_pair(low[c],high[c]);
+            if (remaining[j] && r.first<r.second) {
+              if (r.first>0) fm.prefetch_marks(r.first-1);
+              fm.prefetch_marks(r.second-1);
+              active[k++] = j;
+            }
+          }
+          active.resize(k);
+        }
+      }
+    }
+    
+    
+    
+    /*! \brief read backward the strings of the collection ending at the given rows, by batches of LF walks extended
+     *         in lock-step, the memory accesses of the next step of each walk being prefetched as in backward_search_batch()
+     *  \param rows        rows the walks start from, the suffixes "$" of the strings to read the whole strings
+     *  \param strs        set to the symbols preceding each row up to the first '$', in the order of the strings
+     *  \param ends        set to the row where each walk stopped, the row of the whole string
+     *  \param batch_size  number of walks extended together, large enough to cover the memory latency
+     */
+    template<typename Index>
+    void extract_batch(const Index& fm, const std::vector<uint64_t>& rows, std::vector<std::string>& strs, std::vector<uint64_t>& ends, size_t batch_size = 32) {
+      strs.assign(rows.size(),std::string());
+      ends = rows;
+      std::vector<size_t> active;
+      for(size_t b=0;b<rows.size();b+=batch_size) {
+        active.clear();
+        for(size_t j=b;j<std::min(rows.size(),b+batch_size);++j) {
+          fm.prefetch_marks(ends[j]);
+          active.push_back(j);
+        }
+        while (!active.empty()) {
+          for(auto j:active) fm.prefetch_runs(ends[j]);
+          size_t k = 0;
+          for(auto j:active) {
+            const auto step = fm.lf_step(ends[j]);
+            if (step.first==0) continue;
+            if (strs[j].size() >= fm.bwt().size()) throw std::runtime_error("extract_batch: the bwt string is not a collection of strings");
+            strs[j].push_back(step.first);
+            ends[j] = step.second;
+            fm.prefetch_marks(ends[j]);
+            active[k++] = j;
+          }
+          active.resize(k);
+        }
+      }
+      for(auto& s:strs) std::reverse(s.begin(),s.end());
+    }
+    
+    
+    
+    /*! \struct bi_interval
+     *  \brief synchronized intervals of a string "S" in a bidirectional index:
+     *         [fwd,fwd+size) in the bwt of the collection, and [rev,rev+size) for reverse("S") in the bwt of the reversed collection
+     */
+    struct bi_interval {
+      uint64_t fwd,rev,size;
+    };
+    
+    //! \brief the bi-intervals of the extensions of a string with each symbol of the alphabet of an index
+    template<typename Index>
+    using bi_intervals = std::array<bi_interval,std::tuple_size<typename Index::alpha_count64>::value>;
+    
+    /*! \brief initialize the bi-interval of the empty string, that matches all positions
+     */
+    template<typename Index>
+    inline bi_interval full_range(const Index& fm) {
+      return bi_interval{0,0,fm.bwt().size()};
+    }
+    
+    /*! \brief 1-character prefix extension of the bi-interval x corresponding to string "S"
+     *         Extension is done with all characters of the alphabet.
+     *         ext[c] is set to the bi-interval of string "cS"
+     *  \param fm   index of the collection
+     */
+    template<typename Index>
+    inline void extend_lhs(const Index& fm, bi_intervals<Index>& ext, const bi_interval& x) {
+      typename Index::alpha_count64 low,high;
+      extend_lhs(fm,low,high,x.fwd,x.fwd+x.size);
+      // reverse("cS") = reverse("S")c: sub-intervals of x.rev ordered by c
+      uint64_t rev = x.rev;
+      for(size_t c=0;c<ext.size();++c) {
+        ext[c].fwd = low[c];
+        ext[c].rev = rev;
+        ext[c].size = high[c]-low[c];
+        rev += ext[c].size;
+      }
+    }
+    
+    /*! \brief 1-character suffix extension of the bi-interval x corresponding to string "S"
+     *         Extension is done with all characters of the alphabet.
+     *         ext[c] is set to the bi-interval of string "Sc"
+     *  \param rfm  index of the reversed collection
+     */
+    template<typename Index>
+    inline void extend_rhs(const Index& rfm, bi_intervals<Index>& ext, const bi_interval& x) {
+      typename Index::alpha_count64 low,high;
+      extend_lhs(rfm,low,high,x.rev,x.rev+x.size);
+      // "Sc": sub-intervals of x.fwd ordered by c
+      uint64_t fwd = x.fwd;
+      for(size_t c=0;c<ext.size();++c) {
+        ext[c].fwd = fwd;
+        ext[c].rev = low[c];
+        ext[c].size = high[c]-low[c];
+        fwd += ext[c].size;
+      }
+    }
         
 };
 
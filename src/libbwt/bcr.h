@@ -0,0 +1,175 @@
+#ifndef BCR_H
+#define BCR_H
+
+#include <array>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <cstring>
+#include <cinttypes>
+
+#include "rle.h"
+#include "parallel.h"
+
+namespace bwt {
+
+
+  //! \brief add to counts the number of occurences of each symbol of [first,first+n), symbols being lower than 8
+  inline void count_symbols(const uint8_t* first, uint64_t n, std::array<uint64_t,8>& counts) {
+    // interleaved counters, so that the increments of repeated symbols don't wait for each other
+    uint64_t c[4][8] = {{0}};
+    uint64_t i = 0;
+    for(;i+4<=n;i+=4) {
+      ++c[0][first[i]];
+      ++c[1][first[i+1]];
+      ++c[2][first[i+2]];
+      ++c[3][first[i+3]];
+    }
+    for(;i<n;++i) ++c[0][first[i]];
+    for(size_t x=0;x<8;++x) counts[x] += c[0][x] + c[1][x] + c[2][x] + c[3][x];
+  }
+
+
+  /*! \brief build the bwt of a collection of strings with the BCR algorithm (Bauer, Cox and Rosone, 2013)
+   *         The text is the concatenation of the strings, each one followed by a sentinel 0, their symbols being codes in
+   *         [1,8). The bwt follows the SGA convention: the suffixes "$" of the strings are sorted by string index, so that
+   *         row s of the bwt is the suffix "$" of string s, and equal suffixes are sorted by string index.
+   *         The partial bwt is kept in one segment per first symbol of the suffixes. At round j, the j-th symbol from the
+   *         end of each string is inserted in the segment of its suffix of length j. The insertions of a round are split
+   *         into parts of the segments merged in parallel by num_threads threads, each part also scattering its strings
+   *         to the insertions of the next round with a counting sort by symbol.
+   */
+  inline rle_string bcr_build(const std::string& text, unsigned num_threads = default_num_threads()) {
+    enum {sigma = 8};
+    typedef std::array<uint64_t,sigma> counts_t;
+    // insertion of symbol x=text[off] of a string, at row pos of its segment
+    struct entry_t {
+      uint64_t pos;
+      uint64_t off:56, x:8;
+    };
+    // symbol preceeding text[off] in its string, or 0 at the begining of the string
+    auto previous = [&](uint64_t off) -> uint8_t {
+      const uint8_t x = off ? text[off-1] : 0;
+      if (x>=sigma) throw std::invalid_argument("bcr_build: invalid symbol at offset " + std::to_string(off-1));
+      return x;
+    };
+    if (!text.empty() && text.back()!=0) throw std::invalid_argument("bcr_build: the last string doesn't end with a sentinel");
+
+    // part of the insertions of a round in a segment: insertions [first,last) and old symbols [old_first,old_last)
+    struct part_t {
+      size_t c, first, last;
+      uint64_t old_first, old_last;
+      counts_t counts, inserted; // symbols of the part in the merged segment, and inserted symbols
+      counts_t before, slots;    // symbols of the segment before the part, and first entries of the part in the next round
+    };
+
+    std::array<std::vector<uint8_t>,sigma> segs, bufs;
+    std::array<counts_t,sigma> totals; // totals[c][x] is the number of x in segment c
+    for(auto& t:totals) t.fill(0);
+    std::array<std::vector<entry_t>,sigma> ins, next;
+
+    // the first round inserts the last symbol of the strings at the rows of their suffixes "$", in the order of the strings
+    for(uint64_t off=0;off<text.size();++off) {
+      if (text[off]) continue;
+      entry_t e;
+      e.pos = ins[0].size();
+      e.x = previous(off);
+      e.off = off - (off>0);
+      ins[0].push_back(e);
+    }
+
+    while (true) {
+      // split the insertions into parts proportional to the work of each segment
+      uint64_t work = 0;
+      for(size_t c=0;c<sigma;++c) if (!ins[c].empty()) work += segs[c].size() + ins[c].size();
+      if (work==0) break;
+      std::vector<part_t> parts;
+      for(size_t c=0;c<sigma;++c) {
+        const auto& a = ins[c];
+        if (a.empty()) continue;
+        const uint64_t n = std::max<uint64_t>(1,std::min<uint64_t>(a.size(),(segs[c].size() + a.size()) * 4 * num_threads / work));
+        for(uint64_t p=0;p<n;++p) {
+          part_t part;
+          part.c = c;
+          part.first = a.size() * p / n;
+          part.last = a.size() * (p+1) / n;
+          part.old_first = p ? a[part.first].pos - part.first : 0;
+          if (p) parts.back().old_last = part.old_first;
+          part.old_last = segs[c].size();
+          parts.push_back(part);
+        }
+      }
+
+      // count the old and inserted symbols of each part
+      parallel_for(parts.size(),num_threads,[&](size_t k) {
+        part_t& part = parts[k];
+        part.counts.fill(0);
+        part.inserted.fill(0);
+        const auto& seg = segs[part.c];
+        count_symbols(seg.data() + part.old_first,part.old_last - part.old_first,part.counts);
+        for(size_t i=part.first;i<part.last;++i) ++part.inserted[ins[part.c][i].x];
+        for(size_t x=0;x<sigma;++x) part.counts[x] += part.inserted[x];
+      });
+
+      // prefix sums: symbols before each part in its segment, new totals of the segments, slots of the parts in the next round
+      counts_t num_next;
+      num_next.fill(0);
+      for(auto& part:parts) {
+        if (part.first==0) totals[part.c].fill(0);
+        part.before = totals[part.c];
+        part.slots = num_next;
+        for(size_t x=0;x<sigma;++x) {
+          totals[part.c][x] += part.counts[x];
+          num_next[x] += part.inserted[x];
+        }
+      }
+      std::array<counts_t,sigma> base; // base[c][x] is the number of x in the segments before c
+      counts_t sum;
+      sum.fill(0);
+      for(size_t c=0;c<sigma;++c) {
+        base[c] = sum;
+        for(size_t x=0;x<sigma;++x) sum[x] += totals[c][x];
+      }
+      for(size_t x=0;x<sigma;++x) next[x].resize(x ? num_next[x] : 0);
+      for(size_t c=0;c<sigma;++c) if (!ins[c].empty()) bufs[c].resize(segs[c].size() + ins[c].size());
+
+      // merge the parts: the row of the extended suffix xS of a string is the number of x before the row of S in the bwt
+      parallel_for(parts.size(),num_threads,[&](size_t k) {
+        part_t& part = parts[k];
+        const auto& seg = segs[part.c];
+        const auto& a = ins[part.c];
+        auto& buf = bufs[part.c];
+        counts_t mc = part.before;
+        uint64_t p = part.old_first, q = part.old_first + part.first;
+        for(size_t i=part.first;i<part.last;++i) {
+          // the symbols of the next round are read at random in the text
+          if (i + 16 < part.last) __builtin_prefetch(text.data() + a[i+16].off);
+          const uint64_t n = a[i].pos - q;
+          std::memcpy(buf.data() + q,seg.data() + p,n);
+          count_symbols(seg.data() + p,n,mc);
+          p += n;
+          q += n;
+          const uint8_t x = a[i].x;
+          buf[q++] = x;
+          if (x) {
+            entry_t& e = next[x][part.slots[x]++];
+            e.pos = base[part.c][x] + mc[x];
+            e.x = previous(a[i].off);
+            e.off = a[i].off - (a[i].off>0);
+          }
+          ++mc[x];
+        }
+        std::memcpy(buf.data() + q,seg.data() + p,part.old_last - p);
+      });
+      for(size_t c=0;c<sigma;++c) if (!ins[c].empty()) std::swap(segs[c],bufs[c]);
+      std::swap(ins,next);
+    }
+
+    rle_string bwt;
+    for(const auto& seg:segs) for(auto x:seg) bwt.push_back(x);
+    return bwt;
+  }
+
+};
+
+#endif
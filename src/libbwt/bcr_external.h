@@ -0,0 +1,276 @@
+#ifndef BCREXTERNAL_H
+#define BCREXTERNAL_H
+
+#include <array>
+#include <vector>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <stdexcept>
+#include <cstdio>
+#include <cinttypes>
+
+#include "bcr.h"
+#include "file_stream.h"
+
+namespace bwt {
+
+
+  /*! \class bcr_external_builder
+   *  \brief BCR construction of the bwt of a collection of strings larger than the memory (BCRext, Bauer, Cox and
+   *         Rosone, 2013), with the same conventions as bcr_build()
+   *         The strings added are transposed into one temporary file per column, column j holding the j-th symbol from
+   *         the end of every string. Round j loads column j, then merges each segment of the partial bwt, streamed from
+   *         its file, with the insertions of the round, streamed from the files written by the previous round, the
+   *         segments being merged in parallel. All the files are read and written sequentially by double buffered
+   *         streams, whose buffers share the memory budget left by the column: fewer segments are merged at once when
+   *         the buffers of all the threads don't fit, and the budget is rejected when the ones of a single merge don't.
+   */
+  class bcr_external_builder {
+  public:
+    //! \brief the temporary files are named after tmp_prefix, and the memory of the buffers is bounded by memory_budget
+    bcr_external_builder(const std::string& tmp_prefix, uint64_t memory_budget, unsigned num_threads = default_num_threads());
+    ~bcr_external_builder();
+
+    //! \brief add a string to the collection, its symbols being codes in [1,8)
+    void add(const std::string& str);
+
+    //! \return number of strings added
+    uint64_t size() const {return _num_strings + _block_lengths.size();}
+
+    //! \brief build the bwt of the strings added, and write it to a SGA BWT file
+    void build(const std::string& bwt_filename);
+
+  private:
+    // buffers of a merge: segment reader, writer and copy buffer, entries reader and one entries writer per symbol,
+    // readers and writers holding two buffers each
+    enum {sigma = 8, buffers_per_merge = 7 + 4 * sigma, min_buffer_size = 1<<12};
+    typedef std::array<uint64_t,sigma> counts_t;
+    // insertion of the symbol of string id at row pos of its segment, pos being local to the segment that wrote it
+    struct entry_t {uint64_t pos, id;};
+
+    bcr_external_builder(const bcr_external_builder&) = delete;
+    bcr_external_builder& operator=(const bcr_external_builder&) = delete;
+
+    std::string column_filename(uint64_t j) const {return _prefix + ".col" + std::to_string(j);}
+    std::string segment_filename(size_t c, uint64_t version) const {return _prefix + ".seg" + std::to_string(c) + "." + std::to_string(version);}
+    std::string entries_filename(size_t c, size_t x, uint64_t round) const {return _prefix + ".ins" + std::to_string(c) + std::to_string(x) + "." + std::to_string(round%2);}
+    void remove_file(const std::string& filename) const {std::remove(filename.c_str());}
+
+    void flush_block();
+
+    std::string _prefix;
+    uint64_t _memory_budget;
+    unsigned _num_threads;
+    uint64_t _num_strings = 0, _num_columns = 0;
+    std::string _block;                   // strings added since the last flush_block()
+    std::vector<uint64_t> _block_lengths;
+    std::vector<std::string> _temporaries; // files to remove at destruction
+  };
+
+
+
+  ////////////////////////////////////////////////
+  //
+  // bcr_external_builder class implementation
+  //
+  ////////////////////////////////////////////////
+
+  inline bcr_external_builder::bcr_external_builder(const std::string& tmp_prefix, uint64_t memory_budget, unsigned num_threads):
+    _prefix(tmp_prefix), _memory_budget(memory_budget), _num_threads(std::max(1u,num_threads)) {
+  }
+
+
+  inline bcr_external_builder::~bcr_external_builder() {
+    for(uint64_t j=0;j<_num_columns;++j) remove_file(column_filename(j));
+    for(const auto& f:_temporaries) remove_file(f);
+  }
+
+
+  inline void bcr_external_builder::add(const std::string& str) {
+    for(auto x:str) {
+      if (x<=0 || x>=sigma) throw std::invalid_argument("bcr_external_builder: invalid symbol in string " + std::to_string(size()));
+    }
+    _block += str;
+    _block_lengths.push_back(str.size());
+    // the block and its transposed column are kept in memory
+    if (2 * _block.size() + 9 * _block_lengths.size() >= _memory_budget) flush_block();
+  }
+
+
+  //! \brief append the strings of the block to the column files, the columns created being padded with 0 for the
+  //!        strings of the previous blocks
+  inline void bcr_external_builder::flush_block() {
+    if (_block_lengths.empty()) return;
+    uint64_t max_length = 0;
+    for(auto l:_block_lengths) max_length = std::max(max_length,l);
+    const uint64_t num_columns = std::max(_num_columns,max_length);
+    std::vector<char> col(_block_lengths.size());
+    for(uint64_t j=0;j<num_columns;++j) {
+      std::ofstream os(column_filename(j),std::ios::binary | std::ios::app);
+      if (!os) throw std::runtime_error("unable to create " + column_filename(j));
+      if (j>=_num_columns) {
+        const std::vector<char> zeros(std::min<uint64_t>(_num_strings,1<<20),0);
+        for(uint64_t n=_num_strings;n;n-=std::min<uint64_t>(n,zeros.size())) os.write(zeros.data(),std::min<uint64_t>(n,zeros.size()));
+      }
+      uint64_t end = 0;
+      for(size_t s=0;s<_block_lengths.size();++s) {
+        end += _block_lengths[s];
+        col[s] = j<_block_lengths[s] ? _block[end-1-j] : 0;
+      }
+      os.write(col.data(),col.size());
+      if (!os) throw std::runtime_error("error while writing " + column_filename(j));
+    }
+    _num_columns = num_columns;
+    _num_strings += _block_lengths.size();
+    _block.clear();
+    _block.shrink_to_fit();
+    _block_lengths.clear();
+    _block_lengths.shrink_to_fit();
+  }
+
+
+  inline void bcr_external_builder::build(const std::string& bwt_filename) {
+    flush_block();
+    const uint64_t m = _num_strings;
+    if (m > _memory_budget / 2) throw std::runtime_error("bcr_external_builder: the memory budget is too small to load a column of " + std::to_string(m) + " strings");
+    if (_memory_budget - m < buffers_per_merge * min_buffer_size) {
+      throw std::runtime_error("bcr_external_builder: the memory budget is too small for the buffers of a merge next to a column of " + std::to_string(m) + " strings, expect at least "
+                               + std::to_string(m + buffers_per_merge * min_buffer_size) + " bytes");
+    }
+
+    std::array<uint64_t,sigma> version;  // version[c] is the version of the file of segment c, 0 when it is empty
+    version.fill(0);
+    std::array<counts_t,sigma> totals;   // totals[c][x] is the number of x in segment c
+    for(auto& t:totals) t.fill(0);
+    std::array<counts_t,sigma> num_ins;  // num_ins[c][x] is the number of insertions in segment x written by segment c
+    for(auto& n:num_ins) n.fill(0);
+    std::vector<uint8_t> column;
+
+    for(uint64_t round=0;;++round) {
+      // segments with insertions in this round, the first round inserting the last symbol of each string in the
+      // segment of the suffixes "$", in the order of the strings
+      std::vector<size_t> segs;
+      for(size_t x=0;x<sigma;++x) {
+        bool inserted = round==0 && x==0 && m>0;
+        for(size_t c=0;c<sigma;++c) inserted |= num_ins[c][x]>0;
+        if (inserted) segs.push_back(x);
+      }
+      if (segs.empty()) break;
+
+      // load the symbols inserted in this round: column round, or 0 for all strings past the longest one
+      column.assign(m,0);
+      if (round < _num_columns) {
+        buffered_reader<uint8_t> is(column_filename(round),std::min<uint64_t>(1<<20,(_memory_budget - m) / 2));
+        if (is.read(column.data(),m)!=m) throw std::runtime_error("bcr_external_builder: truncated column file " + column_filename(round));
+      }
+
+      // base[c][x] is the number of x in the segments before c
+      std::array<counts_t,sigma> base;
+      counts_t sum;
+      sum.fill(0);
+      for(size_t c=0;c<sigma;++c) {
+        base[c] = sum;
+        for(size_t x=0;x<sigma;++x) sum[x] += totals[c][x];
+      }
+
+      // the segments are merged by as many threads as there are merges whose buffers fit in the memory left by the
+      // column, each with at least min_buffer_size bytes per buffer
+      const uint64_t concurrency = std::max<uint64_t>(1,std::min<uint64_t>(std::min<uint64_t>(_num_threads,segs.size()),(_memory_budget - m) / (buffers_per_merge * min_buffer_size)));
+      const uint64_t buffer_bytes = (_memory_budget - m) / (concurrency * buffers_per_merge);
+      std::array<counts_t,sigma> next_ins;
+      for(auto& n:next_ins) n.fill(0);
+
+      // merge each segment: the row of the extended suffix xS of a string is the number of x before the row of S in
+      // the bwt, that is base[c][x] plus the number of x before it in its segment c
+      parallel_for(segs.size(),concurrency,[&](size_t k) {
+        const size_t c = segs[k];
+        std::unique_ptr< buffered_reader<uint8_t> > old_seg;
+        if (version[c]) old_seg.reset(new buffered_reader<uint8_t>(segment_filename(c,version[c]),buffer_bytes));
+        buffered_writer<uint8_t> new_seg(segment_filename(c,version[c]+1),buffer_bytes);
+        std::array<std::unique_ptr< buffered_writer<entry_t> >,sigma> next;
+        std::vector<uint8_t> buf(buffer_bytes);
+        counts_t mc;
+        mc.fill(0);
+        uint64_t q = 0;
+
+        auto insert = [&](const entry_t& e) {
+          // copy the old symbols before the insertion
+          for(uint64_t n = e.pos - q; n;) {
+            const size_t len = old_seg ? old_seg->read(buf.data(),std::min<uint64_t>(n,buf.size())) : 0;
+            if (len==0) throw std::runtime_error("bcr_external_builder: insertion past the end of segment " + std::to_string(c));
+            count_symbols(buf.data(),len,mc);
+            new_seg.write(buf.data(),len);
+            n -= len;
+            q += len;
+          }
+          const uint8_t x = column[e.id];
+          new_seg.push_back(x);
+          ++q;
+          if (x) {
+            if (!next[x]) next[x].reset(new buffered_writer<entry_t>(entries_filename(c,x,round+1),buffer_bytes / sizeof(entry_t)));
+            next[x]->push_back(entry_t{mc[x],e.id});
+          }
+          ++mc[x];
+        };
+
+        if (round==0) {
+          for(uint64_t s=0;s<m;++s) insert(entry_t{s,s});
+        } else {
+          // the insertions written by the segments before c come first
+          for(size_t p=0;p<sigma;++p) {
+            if (num_ins[p][c]==0) continue;
+            buffered_reader<entry_t> is(entries_filename(p,c,round),buffer_bytes / sizeof(entry_t));
+            for(entry_t e;is.next(e);) {
+              e.pos += base[p][c];
+              insert(e);
+            }
+          }
+        }
+        while (old_seg) {
+          const size_t len = old_seg->read(buf.data(),buf.size());
+          if (len==0) break;
+          count_symbols(buf.data(),len,mc);
+          new_seg.write(buf.data(),len);
+        }
+        new_seg.close();
+        for(size_t x=0;x<sigma;++x) {
+          if (!next[x]) continue;
+          next[x]->close();
+          next_ins[c][x] = next[x]->size();
+        }
+        totals[c] = mc;
+      });
+
+      // the merged segments replace the old ones, the insertions of the next round replace the ones of this round
+      for(auto c:segs) {
+        if (version[c]) remove_file(segment_filename(c,version[c]));
+        ++version[c];
+        _temporaries.push_back(segment_filename(c,version[c]));
+      }
+      for(size_t c=0;c<sigma;++c) {
+        for(size_t x=0;x<sigma;++x) {
+          if (num_ins[c][x]) remove_file(entries_filename(c,x,round));
+          if (next_ins[c][x]) _temporaries.push_back(entries_filename(c,x,round+1));
+        }
+      }
+      num_ins = next_ins;
+    }
+
+    // the bwt is the concatenation of the segments, read by a double buffered reader and a copy buffer
+    rle_bwt_writer os(bwt_filename);
+    std::vector<uint8_t> buf(std::min<uint64_t>(1<<20,_memory_budget / 3));
+    for(size_t c=0;c<sigma;++c) {
+      if (!version[c]) continue;
+      buffered_reader<uint8_t> is(segment_filename(c,version[c]),buf.size());
+      for(size_t len;(len = is.read(buf.data(),buf.size()));) {
+        for(size_t i=0;i<len;++i) os.push_back(buf[i]);
+      }
+      remove_file(segment_filename(c,version[c]));
+    }
+    os.close();
+  }
+
+};
+
+#endif
@@ -0,0 +1,507 @@
+#ifndef COMPRESSEDINDEX_H
+#define COMPRESSEDINDEX_H
+
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include <array>
+#include <queue>
+#include <atomic>
+#include <iostream>
+#include <stdexcept>
+#include <cinttypes>
+#include <cassert>
+
+#include "rle.h"
+#include "simd.h"
+#include "fm_index.h"
+
+namespace bwt {
+
+
+  /*! \class run_huffman_code
+   *  \brief canonical Huffman codes of the runs of a bwt string, one code per context
+   *         The context of a run is the value of the previous run of its block, and whether that run is full: a full run
+   *         is mostly followed by a run of the same value, and a non full run never is. Codewords are limited to
+   *         max_length bits, written LSB first, so that a run is decoded with a single lookup in the table of its context.
+   */
+  class run_huffman_code {
+  public:
+    enum {num_contexts = 17, block_start = 16, max_length = 10};
+    typedef std::array<uint64_t,256> histogram_t;
+
+    //! \return context of the run following run r
+    static inline size_t context(const run_t r) {return r.value() + (r.full() ? 8 : 0);}
+
+    //! \brief build the codes of the runs counted in the histogram of each context
+    run_huffman_code(const std::array<histogram_t,num_contexts>& histograms);
+
+    //! \brief codeword of run r in context ctx, and its length in bits
+    inline uint32_t code(size_t ctx, run_t r) const {return _codes[ctx][r._data];}
+    inline uint8_t length(size_t ctx, run_t r) const {return _lengths[ctx][r._data];}
+
+    //! \brief decode the run at the low bits of x in the context whose table starts at offset t of the decoding table
+    //! \return the run in the low byte, the length of its codeword in the second byte, and the offset of the table of
+    //!         the next context in the high bits
+    static inline uint32_t decode(const uint32_t* table, uint32_t t, uint64_t x) {return table[t | (x & ((1u << max_length) - 1))];}
+
+    //! \return the decoding table, to be hoisted out of the decoding loops
+    const uint32_t* table() const {return _table.data();}
+
+    //! \return the offset of the table of context ctx
+    static inline uint32_t table_offset(size_t ctx) {return ctx << max_length;}
+
+    //! \return the memory used by the decoding table, in bytes
+    size_t table_bytes() const {return _table.size() * sizeof(uint32_t);}
+
+  private:
+    //! \brief set the lengths of the codewords of the symbols of the histogram, at most max_length bits
+    static void code_lengths(histogram_t freq, std::array<uint8_t,256>& len);
+
+    std::array<std::array<uint32_t,256>,num_contexts> _codes;
+    std::array<std::array<uint8_t,256>,num_contexts> _lengths;
+    std::vector<uint32_t> _table;
+  };
+
+
+
+  /*! \class compressed_fm_index
+   *  \brief FM index whose run array is entropy coded by blocks, for bwt strings too large for the run-length encoding
+   *         alone to fit in memory
+   *         Block k holds the runs covering the positions of the small mark k (see fm_sampling): from the run containing
+   *         its first position, whose occurences before it are stored in the mark with the offset of the block in the
+   *         bit stream, to the run containing its last position. A run crossing two blocks is coded in both, so that the
+   *         blocks are decoded independently. A rank decodes the block of its position up to that position, the last
+   *         decoded blocks being kept with the state of their decoder in a small cache of each thread, that absorbs the
+   *         locality of the depth first traversals.
+   *         The runs of the rle_string are no longer read once the index is built: when the string is mapped from a file,
+   *         its pages are dropped from the memory of the process.
+   */
+  template <size_t AlphabetSize>
+  class compressed_fm_index {
+  public:
+    //
+    // public types definitions
+    //
+    //! \brief define an array of numbers for each alphabet character
+    typedef std::array<uint64_t,AlphabetSize> alpha_count64;
+
+    //
+    // constructors
+    //
+    //! \brief build the index of the given bwt string, in two passes over its runs. The string is moved into the index,
+    //!        that owns it. A block spans the interval of the small marks of the sampling.
+    compressed_fm_index(rle_string bwt, fm_sampling sampling = fm_sampling());
+
+    //
+    // methods
+    //
+    //! \return size of the alphabet
+    size_t alphabet_size() const {return AlphabetSize;}
+
+    //! \return number of occurence of symbol c in bwt[0..i]
+    inline alpha_count64 occ(const uint64_t i) const {
+      uint8_t c;
+      return occ(i,c);
+    }
+
+    //! \return occ(.,i) and occ(.,j) with i<=j, the block being decoded once when both positions are in it
+    inline std::pair<alpha_count64,alpha_count64> occ_pair(const uint64_t i, const uint64_t j) const {
+      assert(i<=j);
+      if ((i>>_sampling.shift16) != (j>>_sampling.shift16)) return std::make_pair(occ(i),occ(j));
+      uint64_t run_first;
+      alpha_count64 n;
+      const cached_block_t& b = block_at(i,j,n,run_first);
+      size_t k = 0;
+      const run_t ri = scan_to(b,k,n,run_first,i);
+      std::pair<alpha_count64,alpha_count64> r(n,n);
+      r.first[ri.value()] += i + 1 - run_first;
+      const run_t rj = scan_to(b,k,r.second,run_first,j);
+      r.second[rj.value()] += j + 1 - run_first;
+      return r;
+    }
+
+    //! \brief the rle_string indexed by the object and storing the BWT, whose runs are not read by the index
+    const rle_string& bwt() const {return _bwt;}
+
+    //! \brief number of occurence of symbols [0..c) in bwt string.
+    const alpha_count64& C() const {return _C;}
+
+    //! \return last to first mapping at position i for all characters of the alphabet
+    inline alpha_count64 lf(const uint64_t i) const {
+      auto n(occ(i));
+      std::transform(n.begin(),n.end(),C().begin(),n.begin(),std::plus<uint64_t>());
+      return n;
+    }
+
+    //! \return bwt[i], the ith character of bwt string
+    inline uint8_t operator[](const uint64_t i) const {
+      uint8_t c;
+      occ(i,c);
+      return c;
+    }
+
+    //! \return the symbol c=bwt[i] and the row lf(i)[c]-1 of the suffix preceding the one of row i, with a single rank
+    inline std::pair<uint8_t,uint64_t> lf_step(const uint64_t i) const {
+      uint8_t c;
+      const alpha_count64 n = occ(i,c);
+      return std::make_pair(c,_C[c] + n[c] - 1);
+    }
+
+    //! \brief prefetch the marks read by occ(i), so that the memory accesses of independent ranks overlap
+    inline void prefetch_marks(const uint64_t i) const {
+      __builtin_prefetch(&_marks64[i>>_sampling.shift64]);
+      __builtin_prefetch(&_marks16[i>>_sampling.shift16]);
+    }
+
+    //! \brief prefetch the start of the block read by occ(i) in the bit stream, once its marks are in cache
+    inline void prefetch_runs(const uint64_t i) const {
+      const uint64_t p = _marks64[i>>_sampling.shift64].bit_offset + _marks16[i>>_sampling.shift16].bit_offset;
+      __builtin_prefetch(&_bits[p>>6]);
+    }
+
+    //! \brief output debugging informations to the given stream
+    void print_debug_info(std::ostream& os) const;
+
+    //! \return the memory used by the coded runs, the marks and the decoding tables, in bytes
+    size_t marks_bytes() const {
+      return _bits.size() * sizeof(uint64_t) + _marks64.size() * sizeof(mark64_t) + _marks16.size() * sizeof(mark16_t) + _code.table_bytes();
+    }
+
+    //! \return the sampling intervals of the marks, the small marks delimiting the blocks
+    const fm_sampling& sampling() const {return _sampling;}
+
+    //! \brief select the instruction set used to scan the decoded runs, the best one supported by the cpu is used by default
+    void set_simd_level(simd_level level) {_skip_runs = skip_runs_kernel<AlphabetSize>(level);}
+
+    //! \brief enable or disable the cache of the decoded blocks, enabled by default
+    void set_cache(bool enabled) {_use_cache = enabled;}
+
+  private:
+    //
+    // internal types
+    //
+    typedef std::array<uint16_t,AlphabetSize> alpha_count16;
+    // offset of the block in the bit stream, and occurences before its first run
+    struct mark64_t {uint64_t bit_offset; alpha_count64 counts;};
+    struct mark16_t {uint32_t bit_offset; alpha_count16 counts;};  // relative to the preceeding mark64_t
+    // runs of a block decoded up to the position end, and the state of the decoder to decode the next ones
+    struct cached_block_t {
+      uint64_t owner = 0, block = 0;
+      size_t size = 0, ctx = 0;
+      uint64_t bit_offset = 0, end = 0;
+      std::vector<run_t> runs;
+    };
+    enum {cache_size = 64};
+
+    //! \return an identifier of the index in the caches, unique among the indices of the process
+    static uint64_t next_id() {
+      static std::atomic<uint64_t> id(1);
+      return id++;
+    }
+
+    //! \return the cache of decoded blocks of the calling thread, direct mapped
+    static std::array<cached_block_t,cache_size>& thread_cache() {
+      static thread_local std::array<cached_block_t,cache_size> cache;
+      return cache;
+    }
+
+    //
+    // internal attributes
+    //
+    std::vector<uint64_t> _bits;      // codewords of the blocks, padded with a word for the unaligned reads
+    std::vector<mark64_t> _marks64;
+    std::vector<mark16_t> _marks16;
+    run_huffman_code _code;
+    rle_string _bwt;
+    alpha_count64 _C;
+    fm_sampling _sampling;
+    uint64_t _num_runs = 0, _num_coded_runs = 0, _num_bits = 0;
+    uint64_t _id = next_id();
+    bool _use_cache = true;
+    skip_runs_fn _skip_runs = skip_runs_kernel<AlphabetSize>(detect_simd_level());
+
+    //
+    // internal methods
+    //
+    //! \return occ(i), and set c to bwt[i]
+    inline alpha_count64 occ(const uint64_t i, uint8_t& c) const {
+      uint64_t run_first;
+      alpha_count64 n;
+      const cached_block_t& b = block_at(i,i,n,run_first);
+      size_t k = 0;
+      const run_t r = scan_to(b,k,n,run_first,i);
+      c = r.value();
+      n[c] += i + 1 - run_first;
+      return n;
+    }
+
+    //! \return the runs of the block of position i, decoded at least up to position last of the block, n being set to
+    //!         the occurences before its first run, that starts at position run_first
+    inline const cached_block_t& block_at(const uint64_t i, const uint64_t last, alpha_count64& n, uint64_t& run_first) const {
+      const uint64_t k = i >> _sampling.shift16;
+      const mark64_t& m64 = _marks64[i>>_sampling.shift64];
+      const mark16_t& m16 = _marks16[k];
+      for(size_t x=0;x<AlphabetSize;++x) n[x] = m64.counts[x] + m16.counts[x];
+      run_first = std::accumulate(n.begin(),n.end(),uint64_t(0));
+      cached_block_t& slot = thread_cache()[_use_cache ? k % cache_size : 0];
+      if (!_use_cache || slot.owner != _id || slot.block != k) {
+        slot.owner = _use_cache ? _id : 0;
+        slot.block = k;
+        slot.size = 0;
+        slot.ctx = run_huffman_code::block_start;
+        slot.bit_offset = m64.bit_offset + m16.bit_offset;
+        slot.end = run_first;
+        // a block holds at most one run per position, and the run of its first position
+        if (slot.runs.size() <= (size_t(1) << _sampling.shift16)) slot.runs.resize((size_t(1) << _sampling.shift16) + 1);
+      }
+      if (slot.end <= last) decode_to(slot,last);
+      return slot;
+    }
+
+    //! \brief decode the next runs of block b up to the one containing position last. Several codewords are read from
+    //!        each 64 bits window of the stream.
+    inline void decode_to(cached_block_t& b, const uint64_t last) const {
+      // the stores of the runs may alias the attributes and the state of the decoder, that are kept in locals
+      const uint32_t* table = _code.table();
+      const uint64_t* bits = _bits.data();
+      run_t* runs = b.runs.data();
+      size_t n = b.size;
+      uint32_t t = run_huffman_code::table_offset(b.ctx);
+      uint64_t p = b.bit_offset, pos = b.end;
+      while (pos <= last) {
+        const unsigned o = p & 63;
+        uint64_t x = bits[p>>6] >> o;
+        if (o) x |= bits[(p>>6) + 1] << (64 - o);
+        unsigned used = 0;
+        do {
+          const uint32_t e = run_huffman_code::decode(table,t,x >> used);
+          run_t r;
+          r._data = e & 0xFF;
+          runs[n++] = r;
+          used += (e >> 8) & 0xFF;
+          pos += r.length();
+          t = e >> 16;
+        } while (pos <= last && used <= 64 - run_huffman_code::max_length);
+        p += used;
+      }
+      b.size = n;
+      b.ctx = t >> run_huffman_code::max_length;
+      b.bit_offset = p;
+      b.end = pos;
+    }
+
+    //! \brief move the counts n of the runs of block b before run k, starting at position run_first, forward to the run
+    //!        containing position i
+    //! \return the run containing position i
+    inline run_t scan_to(const cached_block_t& b, size_t& k, alpha_count64& n, uint64_t& run_first, const uint64_t i) const {
+      const run_t* runs = b.runs.data();
+      k += _skip_runs(runs + k,b.size - k,i - run_first,n.data(),run_first);
+      for(;;++k) {
+        const auto len = runs[k].length();
+        if (i < run_first + len) return runs[k];
+        run_first += len;
+        n[runs[k].value()] += len;
+      }
+    }
+
+    //! \brief call f.block(k,counts) for each block k with the occurences before its first run, then f.run(ctx,r) for
+    //!        each run r of the block coded in context ctx
+    template<typename F>
+    void for_each_block(F& f) const;
+  };
+
+
+
+  ////////////////////////////////////////////////
+  //
+  // run_huffman_code class implementation
+  //
+  ////////////////////////////////////////////////
+
+  inline void run_huffman_code::code_lengths(histogram_t freq, std::array<uint8_t,256>& len) {
+    for(;;) {
+      // merge the two least frequent trees until a single one remains, the depth of a leaf being its codeword length
+      typedef std::pair<uint64_t,size_t> node_t;
+      std::priority_queue<node_t,std::vector<node_t>,std::greater<node_t> > q;
+      std::vector<size_t> parent;
+      for(size_t x=0;x<256;++x) {
+        if (freq[x]) q.push(node_t(freq[x],x));
+        parent.push_back(0);
+      }
+      len.fill(0);
+      if (q.size()==1) len[q.top().second] = 1;
+      while (q.size()>1) {
+        const node_t a = q.top(); q.pop();
+        const node_t b = q.top(); q.pop();
+        parent[a.second] = parent[b.second] = parent.size();
+        parent.push_back(0);
+        q.push(node_t(a.first + b.first,parent.size() - 1));
+      }
+      uint8_t longest = 0;
+      for(size_t x=0;x<256;++x) {
+        if (!freq[x]) continue;
+        for(size_t y=x;parent[y];y=parent[y]) ++len[x];
+        longest = std::max(longest,len[x]);
+      }
+      if (longest <= max_length) return;
+      // flatten the distribution, down to a balanced tree of 8 bits at most
+      for(auto& f:freq) f = (f + 1) / 2;
+    }
+  }
+
+
+  inline run_huffman_code::run_huffman_code(const std::array<histogram_t,num_contexts>& histograms): _table(num_contexts << max_length,0) {
+    for(size_t ctx=0;ctx<num_contexts;++ctx) {
+      auto& len = _lengths[ctx];
+      code_lengths(histograms[ctx],len);
+      // canonical codes, by increasing length then symbol, bit reversed to be read LSB first
+      std::vector<size_t> symbols;
+      for(size_t x=0;x<256;++x) if (len[x]) symbols.push_back(x);
+      std::sort(symbols.begin(),symbols.end(),[&](size_t a, size_t b) {return len[a]!=len[b] ? len[a]<len[b] : a<b;});
+      _codes[ctx].fill(0);
+      uint32_t code = 0;
+      uint8_t prev = 0;
+      for(auto x:symbols) {
+        code <<= len[x] - prev;
+        prev = len[x];
+        uint32_t rev = 0;
+        for(uint8_t b=0;b<len[x];++b) rev |= ((code >> b) & 1) << (len[x] - 1 - b);
+        _codes[ctx][x] = rev;
+        // every window whose low bits are the codeword decodes to x
+        run_t r;
+        r._data = x;
+        for(uint32_t y=rev;y<(1u << max_length);y+=(1u << len[x])) _table[(ctx << max_length) | y] = x | (len[x] << 8) | (table_offset(context(r)) << 16);
+        ++code;
+      }
+    }
+  }
+
+
+
+  ////////////////////////////////////////////////
+  //
+  // compressed_fm_index class implementation
+  //
+  ////////////////////////////////////////////////
+
+  template <size_t AlphabetSize>
+  template<typename F>
+  void compressed_fm_index<AlphabetSize>::for_each_block(F& f) const {
+    const auto runs = _bwt.runs();
+    const uint64_t n = _bwt.size();
+    const uint64_t num_blocks = (n + (uint64_t(1) << _sampling.shift16) - 1) >> _sampling.shift16;
+    alpha_count64 counts;
+    counts.fill(0);
+    size_t r = 0;
+    uint64_t run_first = 0;
+    for(uint64_t k=0;k<num_blocks;++k) {
+      // move to the run containing the first position of the block
+      const uint64_t first = k << _sampling.shift16, end = std::min(n,first + (uint64_t(1) << _sampling.shift16));
+      for(;run_first + runs[r].length() <= first;++r) {
+        counts[runs[r].value()] += runs[r].length();
+        run_first += runs[r].length();
+      }
+      f.block(k,counts);
+      size_t ctx = run_huffman_code::block_start;
+      for(uint64_t pos=run_first,j=r;pos<end;++j) {
+        f.run(ctx,runs[j]);
+        pos += runs[j].length();
+        ctx = run_huffman_code::context(runs[j]);
+      }
+    }
+  }
+
+
+  template <size_t AlphabetSize>
+  compressed_fm_index<AlphabetSize>::compressed_fm_index(rle_string bwt, fm_sampling sampling):
+    _code(std::array<run_huffman_code::histogram_t,run_huffman_code::num_contexts>()), _bwt(std::move(bwt)), _sampling(sampling) {
+    const auto runs = _bwt.runs();
+    alpha_count64 counts;
+    counts.fill(0);
+    for(size_t k=0;k<runs.size();++k) {
+      if (runs[k].value()>=AlphabetSize) throw std::runtime_error("compressed_fm_index: invalid symbol in the bwt string");
+      if (runs[k].length()==0) throw std::runtime_error("compressed_fm_index: empty run in the bwt string");
+      if (k==0 || runs[k].value()!=runs[k-1].value()) ++_num_runs;
+      counts[runs[k].value()] += runs[k].length();
+    }
+    if (std::accumulate(counts.begin(),counts.end(),uint64_t(0)) != _bwt.size()) throw std::runtime_error("compressed_fm_index: the runs don't match the size of the bwt string");
+
+    // first pass: histogram of the runs of each context, to build the codes
+    struct histogram_pass {
+      std::array<run_huffman_code::histogram_t,run_huffman_code::num_contexts> h;
+      uint64_t num_runs = 0;
+      void block(uint64_t,const alpha_count64&) {}
+      void run(size_t ctx, run_t r) {++h[ctx][r._data];++num_runs;}
+    } hp;
+    for(auto& h:hp.h) h.fill(0);
+    for_each_block(hp);
+    _code = run_huffman_code(hp.h);
+    _num_coded_runs = hp.num_runs;
+
+    // second pass: code the blocks, and set their marks
+    struct encode_pass {
+      const run_huffman_code& code;
+      const fm_sampling& sampling;
+      std::vector<uint64_t>& bits;
+      std::vector<mark64_t>& marks64;
+      std::vector<mark16_t>& marks16;
+      uint64_t num_bits;
+      void block(uint64_t k, const alpha_count64& counts) {
+        if ((k << sampling.shift16) % (uint64_t(1) << sampling.shift64) == 0) marks64.push_back(mark64_t{num_bits,counts});
+        const mark64_t& m64 = marks64.back();
+        mark16_t m16;
+        m16.bit_offset = num_bits - m64.bit_offset;
+        for(size_t x=0;x<AlphabetSize;++x) m16.counts[x] = counts[x] - m64.counts[x];
+        marks16.push_back(m16);
+      }
+      void run(size_t ctx, run_t r) {
+        const uint64_t c = code.code(ctx,r);
+        const unsigned l = code.length(ctx,r), o = num_bits & 63;
+        if (o==0) bits.push_back(0);
+        bits.back() |= c << o;
+        if (o + l > 64) bits.push_back(c >> (64 - o));
+        num_bits += l;
+      }
+    } ep{_code,_sampling,_bits,_marks64,_marks16,0};
+    uint64_t num_bits = 0;
+    for(size_t ctx=0;ctx<run_huffman_code::num_contexts;++ctx) {
+      for(size_t x=0;x<256;++x) {
+        run_t r;
+        r._data = x;
+        num_bits += hp.h[ctx][x] * _code.length(ctx,r);
+      }
+    }
+    _bits.reserve(num_bits / 64 + 3);
+    for_each_block(ep);
+    _bits.resize(num_bits / 64 + 2,0);
+    _num_bits = num_bits;
+
+    // C[c] is the count of lexicography smaller symbols [0..c)
+    uint64_t s = 0;
+    for(size_t c=0;c<_C.size();++c) {
+      _C[c] = s;
+      s += counts[c];
+    }
+
+    // the runs of a mapped string are no longer needed in memory
+    _bwt.release();
+  }
+
+
+  template <size_t AlphabetSize>
+  void compressed_fm_index<AlphabetSize>::print_debug_info(std::ostream& os) const {
+    os << "size:" << _bwt.size() << std::endl;
+    os << "layout:compressed" << std::endl;
+    os << "#run:" << _bwt.runs().size() << " (" << _num_coded_runs << " coded in the blocks, " << _num_runs << " maximal)" << std::endl;
+    os << "block size:" << (uint64_t(1) << _sampling.shift16) << std::endl;
+    os << "bits/run:" << _num_bits * 1.0 / std::max<uint64_t>(1,_num_coded_runs) << std::endl;
+    os << "index:" << marks_bytes() / 1024.0 / 1024.0 << "Mo" << std::endl;
+    const double n = std::max<uint64_t>(1,_bwt.size());
+    os << "bytes/symbol:" << marks_bytes() / n << std::endl;
+  }
+
+};
+
+#endif
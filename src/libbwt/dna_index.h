@@ -0,0 +1,209 @@
+#ifndef DNAINDEX_H
+#define DNAINDEX_H
+
+
+#include <memory>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "fm_index.h"
+#include "packed_index.h"
+#include "run_index.h"
+#include "compressed_index.h"
+
+namespace bwt {
+
+
+  /*! \class dna_index
+   *  \brief index of a DNA bwt string (alphabet $ACGT) backed either by the run-length encoded fm_index,
+   *         or by the 2-bit packed_dna_index when the runs are too short for the run-length encoding to pay off,
+   *         or by the run_dna_index of the maximal runs for highly repetitive collections,
+   *         or by the compressed_fm_index of the entropy coded runs when the run array doesn't fit in memory
+   */
+  class dna_index {
+  public:
+    //
+    // public types definitions
+    //
+    typedef fm_index<5> rle_index;
+    typedef rle_index::alpha_count64 alpha_count64;
+    typedef compressed_fm_index<5> compressed_index;
+    enum backend_t {AUTO_BACKEND = 0, RLE_BACKEND, PACKED_BACKEND, RUNS_BACKEND, COMPRESSED_BACKEND};
+
+    //! \return the backend best suited to the bwt string
+    //!         Below 3 symbols per run on average, the runs and the marks of the rle index (1 byte per run and about
+    //!         0.09 byte per symbol with the default sampling) take more than the blocks of the packed index (1/3 byte
+    //!         per symbol, and 8 bytes per '$'), that releases the runs of a mapped string and has in addition a
+    //!         constant rank time. The runs and compressed backends are never selected: the first one depends on the
+    //!         length of the maximal runs, only known once they are merged, the second one trades speed for memory.
+    static backend_t select_backend(const rle_string& bwt) {return bwt.avg_run_length() < 3 ? PACKED_BACKEND : RLE_BACKEND;}
+
+    //! \return the backend named "auto", "rle", "packed", "runs" or "compressed"
+    static backend_t parse_backend(const std::string& str) {
+      if (str=="auto") return AUTO_BACKEND;
+      if (str=="rle") return RLE_BACKEND;
+      if (str=="packed") return PACKED_BACKEND;
+      if (str=="runs") return RUNS_BACKEND;
+      if (str=="compressed") return COMPRESSED_BACKEND;
+      throw std::invalid_argument("invalid index backend: " + str);
+    }
+
+    //! \return printable name of a backend
+    static const char* backend_name(backend_t backend) {
+      switch(backend) {
+        case RLE_BACKEND: return "rle";
+        case PACKED_BACKEND: return "packed";
+        case RUNS_BACKEND: return "runs";
+        case COMPRESSED_BACKEND: return "compressed";
+        default: return "auto";
+      }
+    }
+
+    //! \return true when the backend no longer reads the runs of the bwt string once built, the string being better
+    //!         mapped from its file so that its pages are released
+    static bool releases_bwt(backend_t backend) {return backend==PACKED_BACKEND || backend==RUNS_BACKEND || backend==COMPRESSED_BACKEND;}
+
+    //! \brief load the index of a SGA BWT file with the given backend, the marks of the rle backend being mapped from
+    //!        the index file written by bwt-index next to it when it exists (see fm_index_filename()). With the auto
+    //!        backend, the file is mapped to choose the backend from its header. The runs are read in memory for the
+    //!        backends reading them unless mmap is set, and mapped for the others, that release them once indexed.
+    //!        When a sampling is given, an index file with another sampling is not used: the index is built with the
+    //!        given sampling instead. Otherwise, the index file is used with its own sampling, the default sampling
+    //!        being used by the indices built.
+    static dna_index load(const std::string& filename, backend_t backend = AUTO_BACKEND, const fm_sampling* sampling = nullptr,
+                          unsigned num_threads = default_num_threads(), bool mmap = false, bool populate = false);
+
+    //! \return the usage of the command line options of the tools giving the arguments of load()
+    static const char* load_usage() {
+      return
+      "      -s, --sampling=N                 symbols between the small marks of the indices built at startup, a power\n"
+      "                                       of two, or one of dense (32), default (128) and sparse (1024). An index\n"
+      "                                       X.bwt.fmi saved with another sampling is not used, the index of X.bwt\n"
+      "                                       being built at startup instead (default: the sampling of X.bwt.fmi)\n"
+      "      --backend=NAME                   index of the BWT files: rle (run-length encoded), packed (2 bits per\n"
+      "                                       symbol), runs (maximal runs, for highly repetitive collections),\n"
+      "                                       compressed (runs entropy coded by blocks of the sampling interval,\n"
+      "                                       decoded on demand), or auto to choose between rle and packed from the\n"
+      "                                       average run length (default: auto). The BWT files are mapped, and their\n"
+      "                                       pages released once indexed, by the packed, runs and compressed backends.\n"
+      "                                       The marks of the rle index of X.bwt are mapped from X.bwt.fmi, built by\n"
+      "                                       bwt-index, when it exists\n"
+      "      -m, --mmap                       map the BWT files in memory instead of reading them, the pages are\n"
+      "                                       shared with the other processes using the same files\n"
+      "      --populate                       with --mmap, prefault the whole files at startup\n";
+    }
+
+    //
+    // constructors
+    //
+    //! \brief build the index of the given bwt string with the given backend, the sampling is used by the rle and
+    //!        compressed backends only
+    dna_index(rle_string bwt, unsigned num_threads = default_num_threads(), fm_sampling sampling = fm_sampling(), backend_t backend = AUTO_BACKEND) {
+      if (backend==AUTO_BACKEND) backend = select_backend(bwt);
+      if (backend==PACKED_BACKEND) {
+        _packed.reset(new packed_dna_index(std::move(bwt),num_threads));
+      } else if (backend==RUNS_BACKEND) {
+        _runs.reset(new run_dna_index(std::move(bwt)));
+      } else if (backend==COMPRESSED_BACKEND) {
+        _compressed.reset(new compressed_index(std::move(bwt),sampling));
+      } else {
+        _rle.reset(new rle_index(std::move(bwt),num_threads,sampling));
+      }
+    }
+
+    //! \brief load the marks of the rle backend from an index file previously written by fm_index::save()
+    dna_index(rle_string bwt, const std::string& index_filename, bool populate = false, int advice = MADV_NORMAL):
+      _rle(new rle_index(std::move(bwt),index_filename,populate,advice)) {}
+
+    //
+    // methods
+    //
+    //! \return the backend of the index
+    backend_t backend() const {return _packed ? PACKED_BACKEND : _runs ? RUNS_BACKEND : _compressed ? COMPRESSED_BACKEND : RLE_BACKEND;}
+
+    //! \return size of the alphabet
+    size_t alphabet_size() const {return 5;}
+
+    //! \return number of occurence of symbol c in bwt[0..i]
+    inline alpha_count64 occ(const uint64_t i) const {return _packed ? _packed->occ(i) : _runs ? _runs->occ(i) : _compressed ? _compressed->occ(i) : _rle->occ(i);}
+
+    //! \return occ(.,i) and occ(.,j) with i<=j
+    inline std::pair<alpha_count64,alpha_count64> occ_pair(const uint64_t i, const uint64_t j) const {
+      return _packed ? _packed->occ_pair(i,j) : _runs ? _runs->occ_pair(i,j) : _compressed ? _compressed->occ_pair(i,j) : _rle->occ_pair(i,j);
+    }
+
+    //! \brief the rle_string indexed by the object and storing the BWT
+    const rle_string& bwt() const {return _packed ? _packed->bwt() : _runs ? _runs->bwt() : _compressed ? _compressed->bwt() : _rle->bwt();}
+
+    //! \brief number of occurence of symbols [0..c) in bwt string.
+    const alpha_count64& C() const {return _packed ? _packed->C() : _runs ? _runs->C() : _compressed ? _compressed->C() : _rle->C();}
+
+    //! \return last to first mapping at position i for all characters of the alphabet
+    inline alpha_count64 lf(const uint64_t i) const {return _packed ? _packed->lf(i) : _runs ? _runs->lf(i) : _compressed ? _compressed->lf(i) : _rle->lf(i);}
+
+    //! \return bwt[i], the ith character of bwt string
+    inline uint8_t operator[](const uint64_t i) const {return _packed ? (*_packed)[i] : _runs ? (*_runs)[i] : _compressed ? (*_compressed)[i] : (*_rle)[i];}
+
+    //! \return the symbol c=bwt[i] and the row lf(i)[c]-1 of the suffix preceding the one of row i
+    inline std::pair<uint8_t,uint64_t> lf_step(const uint64_t i) const {return _packed ? _packed->lf_step(i) : _runs ? _runs->lf_step(i) : _compressed ? _compressed->lf_step(i) : _rle->lf_step(i);}
+
+    //! \brief prefetch the memory read by occ(i), see fm_index::prefetch_marks() and fm_index::prefetch_runs()
+    inline void prefetch_marks(const uint64_t i) const {if (_packed) _packed->prefetch_marks(i); else if (_runs) _runs->prefetch_marks(i); else if (_compressed) _compressed->prefetch_marks(i); else _rle->prefetch_marks(i);}
+    inline void prefetch_runs(const uint64_t i) const {if (_packed) _packed->prefetch_runs(i); else if (_runs) _runs->prefetch_runs(i); else if (_compressed) _compressed->prefetch_runs(i); else _rle->prefetch_runs(i);}
+
+    //! \brief output debugging informations to the given stream
+    void print_debug_info(std::ostream& os) const {
+      os << "backend:" << backend_name(backend()) << std::endl;
+      if (_packed) _packed->print_debug_info(os); else if (_runs) _runs->print_debug_info(os); else if (_compressed) _compressed->print_debug_info(os); else _rle->print_debug_info(os);
+    }
+
+    //! \return the memory used by the index on top of the bwt string, in bytes
+    size_t marks_bytes() const {return _packed ? _packed->marks_bytes() : _runs ? _runs->marks_bytes() : _compressed ? _compressed->marks_bytes() : _rle->marks_bytes();}
+
+    //! \brief select the instruction set used by the backend
+    void set_simd_level(simd_level level) {if (_packed) _packed->set_simd_level(level); else if (_runs) _runs->set_simd_level(level); else if (_compressed) _compressed->set_simd_level(level); else _rle->set_simd_level(level);}
+
+  private:
+    std::unique_ptr<rle_index> _rle;
+    std::unique_ptr<packed_dna_index> _packed;
+    std::unique_ptr<run_dna_index> _runs;
+    std::unique_ptr<compressed_index> _compressed;
+  };
+
+
+
+
+  ////////////////////////////////////////////////
+  //
+  // dna_index class implementation
+  //
+  ////////////////////////////////////////////////
+
+  inline dna_index dna_index::load(const std::string& filename, backend_t backend, const fm_sampling* sampling, unsigned num_threads, bool mmap, bool populate) {
+    const std::string index_filename = fm_index_filename(filename);
+    bool has_index = static_cast<bool>(std::ifstream(index_filename));
+    if (has_index && sampling && (backend==AUTO_BACKEND || backend==RLE_BACKEND) && read_fm_index_sampling(index_filename) != *sampling) {
+      std::cerr << index_filename << " has been saved with another sampling, the index is built with the requested one" << std::endl;
+      has_index = false;
+    }
+    if (backend==AUTO_BACKEND && has_index) backend = RLE_BACKEND;
+    // the file is mapped to choose the backend from its header, and read again when the backend reads its runs
+    const bool mapped = mmap || backend==AUTO_BACKEND || releases_bwt(backend);
+    rle_string bwt = mapped ? map_rle_bwt(filename,populate,MADV_RANDOM) : read_rle_bwt(filename);
+    if (backend==AUTO_BACKEND) {
+      backend = select_backend(bwt);
+      if (!mmap && !releases_bwt(backend)) bwt = read_rle_bwt(filename);
+    }
+    if (backend==RLE_BACKEND && has_index) {
+      std::cerr << "loading index " << index_filename << std::endl;
+      return dna_index(std::move(bwt),index_filename,populate);
+    }
+    std::cerr << "backend:" << backend_name(backend) << std::endl;
+    return dna_index(std::move(bwt),num_threads,sampling ? *sampling : fm_sampling(),backend);
+  }
+
+};
+
+#endif
@@ -0,0 +1,241 @@
+#ifndef FILESTREAM_H
+#define FILESTREAM_H
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+namespace bwt {
+
+
+  /*! \class io_thread
+   *  \brief thread running the background reads or writes of a stream one after the other, created once for the
+   *         lifetime of the stream so that small buffers don't pay the creation of a thread each
+   */
+  class io_thread {
+  public:
+    io_thread(): _thread([this]() {run();}) {}
+
+    ~io_thread() {
+      {
+        std::lock_guard<std::mutex> lck(_mtx);
+        _stop = true;
+      }
+      _cv.notify_all();
+      _thread.join();
+    }
+
+    //! \brief run job in the background, the previous one being waited first
+    void start(std::function<void()> job) {
+      wait();
+      std::lock_guard<std::mutex> lck(_mtx);
+      _job = std::move(job);
+      _busy = true;
+      _cv.notify_all();
+    }
+
+    //! \brief wait for the end of the job started, and rethrow its exception
+    void wait() {
+      std::unique_lock<std::mutex> lck(_mtx);
+      _cv.wait(lck,[this]() {return !_busy;});
+      if (_error) {
+        std::exception_ptr e = _error;
+        _error = nullptr;
+        std::rethrow_exception(e);
+      }
+    }
+
+  private:
+    io_thread(const io_thread&) = delete;
+    io_thread& operator=(const io_thread&) = delete;
+
+    void run() {
+      std::unique_lock<std::mutex> lck(_mtx);
+      for(;;) {
+        _cv.wait(lck,[this]() {return _stop || _job;});
+        if (!_job) return;
+        std::function<void()> job;
+        std::swap(job,_job);
+        lck.unlock();
+        try {job();} catch(...) {lck.lock(); _error = std::current_exception(); lck.unlock();}
+        lck.lock();
+        _busy = false;
+        _cv.notify_all();
+      }
+    }
+
+    std::mutex _mtx;
+    std::condition_variable _cv;
+    std::function<void()> _job;
+    bool _busy = false, _stop = false;
+    std::exception_ptr _error;
+    std::thread _thread; // started last, once the other members are initialized
+  };
+
+
+  /*! \class buffered_reader
+   *  \brief sequential reader of a file of trivially copyable records, double buffered: the next buffer is read by the
+   *         io_thread of the reader while the records of the current one are consumed
+   */
+  template<typename T>
+  class buffered_reader {
+  public:
+    //! \brief open the file and start reading its first buffer of buffer_size records
+    buffered_reader(const std::string& filename, size_t buffer_size): _filename(filename), _buffer_size(std::max<size_t>(1,buffer_size)) {
+      _file = std::fopen(filename.c_str(),"rb");
+      if (!_file) throw std::runtime_error("unable to open " + filename + ": " + std::strerror(errno));
+      _next.resize(_buffer_size);
+      fetch();
+    }
+
+    ~buffered_reader() {
+      try {_io.wait();} catch(...) {}
+      std::fclose(_file);
+    }
+
+    //! \brief read the next record
+    //! \return false at the end of the file
+    inline bool next(T& x) {
+      if (_pos == _cur.size() && !refill()) return false;
+      x = _cur[_pos++];
+      return true;
+    }
+
+    //! \brief read up to n records into [first,first+n)
+    //! \return the number of records read, lower than n at the end of the file only
+    size_t read(T* first, size_t n) {
+      size_t k = 0;
+      while (k < n && (_pos < _cur.size() || refill())) {
+        const size_t m = std::min(n - k,_cur.size() - _pos);
+        std::copy(_cur.begin() + _pos,_cur.begin() + _pos + m,first + k);
+        _pos += m;
+        k += m;
+      }
+      return k;
+    }
+
+  private:
+    buffered_reader(const buffered_reader&) = delete;
+    buffered_reader& operator=(const buffered_reader&) = delete;
+
+    //! \brief start reading the next buffer in the background
+    void fetch() {
+      _pending = true;
+      _io.start([this]() {
+        _fetched = std::fread(_next.data(),sizeof(T),_next.size(),_file);
+        if (_fetched < _next.size() && std::ferror(_file)) throw std::runtime_error("error while reading " + _filename);
+      });
+    }
+
+    //! \brief swap in the buffer read in the background, and start reading the following one
+    bool refill() {
+      if (!_pending) return false;
+      _pending = false;
+      _io.wait();
+      const size_t n = _fetched;
+      _next.resize(n);
+      std::swap(_cur,_next);
+      _pos = 0;
+      if (n == _buffer_size) {
+        _next.resize(_buffer_size);
+        fetch();
+      }
+      return n > 0;
+    }
+
+    std::string _filename;
+    size_t _buffer_size;
+    FILE* _file;
+    std::vector<T> _cur, _next;
+    size_t _pos = 0;
+    size_t _fetched = 0;   // number of records of the last buffer read in the background
+    bool _pending = false; // true while a buffer read in the background is not swapped in
+    io_thread _io;
+  };
+
+
+
+  /*! \class buffered_writer
+   *  \brief sequential writer of a file of trivially copyable records, double buffered: a full buffer is written by the
+   *         io_thread of the writer while the next one is filled
+   */
+  template<typename T>
+  class buffered_writer {
+  public:
+    //! \brief create the file, records being written by buffers of buffer_size records
+    buffered_writer(const std::string& filename, size_t buffer_size): _filename(filename), _buffer_size(std::max<size_t>(1,buffer_size)) {
+      _file = std::fopen(filename.c_str(),"wb");
+      if (!_file) throw std::runtime_error("unable to create " + filename + ": " + std::strerror(errno));
+      _cur.reserve(_buffer_size);
+    }
+
+    ~buffered_writer() {
+      try {close();} catch(...) {}
+    }
+
+    //! \brief append a record to the file
+    inline void push_back(const T& x) {
+      _cur.push_back(x);
+      if (_cur.size() == _buffer_size) flush();
+    }
+
+    //! \brief append n records to the file
+    void write(const T* first, size_t n) {
+      while (n) {
+        const size_t k = std::min(n,_buffer_size - _cur.size());
+        _cur.insert(_cur.end(),first,first + k);
+        first += k;
+        n -= k;
+        if (_cur.size() == _buffer_size) flush();
+      }
+    }
+
+    //! \return number of records written
+    uint64_t size() const {return _size + _cur.size();}
+
+    //! \brief write the remaining records and close the file
+    void close() {
+      if (!_file) return;
+      flush();
+      _io.wait();
+      const bool ok = std::fclose(_file) == 0;
+      _file = nullptr;
+      if (!ok) throw std::runtime_error("error while writing " + _filename);
+    }
+
+  private:
+    buffered_writer(const buffered_writer&) = delete;
+    buffered_writer& operator=(const buffered_writer&) = delete;
+
+    //! \brief write the current buffer in the background, once the previous one is written
+    void flush() {
+      _io.wait();
+      std::swap(_cur,_next);
+      _cur.clear();
+      _cur.reserve(_buffer_size);
+      _size += _next.size();
+      _io.start([this]() {
+        if (std::fwrite(_next.data(),sizeof(T),_next.size(),_file) != _next.size()) throw std::runtime_error("error while writing " + _filename);
+      });
+    }
+
+    std::string _filename;
+    size_t _buffer_size;
+    FILE* _file;
+    std::vector<T> _cur, _next;
+    uint64_t _size = 0;
+    io_thread _io;
+  };
+
+};
+
+#endif
@@ -9,19 +9,103 @@
 #include <array>
 #include <istream>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
 #include <cinttypes>
+#include <type_traits>
 
-#include "rle_string.h"
+#include "rle.h"
+#include "mapped_file.h"
+#include "parallel.h"
+#include "simd.h"
+#include "mark_layout.h"
 
 namespace bwt {
 
 
+  /*! \struct fm_index_header
+   *  \brief header of the files storing a serialized fm_index (see fm_index::save())
+   *         The header is followed by the C array, then the mark arrays, each starting on a 64 bytes boundary
+   *         so that they can be used in place from a memory mapping of the file.
+   */
+  struct fm_index_header {
+    enum {magic = 0x494D4642 /* "BFMI" */, current_version = 2, alignment = 64};
+    uint32_t magic_number;
+    uint32_t version;
+    uint32_t alphabet_size;
+    uint8_t shift64, shift16;
+    uint8_t layout;                    // id of the layout of the small marks
+    uint8_t reserved;
+    uint16_t mark64_size, mark16_size; // sizeof the mark structures, detects incompatible layouts
+    uint64_t bwt_size, num_runs;       // identifies the indexed bwt string
+    uint64_t num_marks64, num_marks16;
+    uint64_t marks64_offset, marks16_offset;
+    
+    //! \return the first offset multiple of the alignment after offset
+    static inline uint64_t align(uint64_t offset) {return (offset + alignment - 1) / alignment * alignment;}
+  };
+  
+  /*! \struct fm_sampling
+   *  \brief sampling intervals of the fm_index marks: one large mark every 2^shift64 symbols, one small mark every 2^shift16 symbols
+   *         Dense sampling makes the ranks faster, sparse sampling makes the index smaller.
+   *         Small marks count relatively to the large marks on 16 bits, thus shift64 is at most 16.
+   */
+  struct fm_sampling {
+    uint8_t shift64, shift16;
+    
+    fm_sampling(uint8_t s16 = 7, uint8_t s64 = 16):shift64(s64),shift16(s16) {
+      if (shift64 > 16 || shift16 > shift64 || shift16 < 3) throw std::invalid_argument("invalid fm_index sampling: expect 3 <= shift16 <= shift64 <= 16");
+    }
+    
+    //! \return the sampling with one small mark every n symbols, n being a power of two
+    static fm_sampling every(uint64_t n) {
+      uint8_t s = 0;
+      while ((uint64_t(1)<<s) < n) ++s;
+      if ((uint64_t(1)<<s) != n) throw std::invalid_argument("invalid fm_index sampling: the interval must be a power of two");
+      return fm_sampling(s);
+    }
+    
+    //! \brief common settings: dense sampling for large memory machines, sparse sampling for shared nodes
+    static fm_sampling dense() {return fm_sampling(5);}
+    static fm_sampling sparse() {return fm_sampling(10);}
+    
+    bool operator==(const fm_sampling& s) const {return shift64==s.shift64 && shift16==s.shift16;}
+    bool operator!=(const fm_sampling& s) const {return !(*this==s);}
+    
+    //! \return the sampling named "dense", "default", "sparse", or given as the number of symbols between small marks
+    static fm_sampling parse(const std::string& str) {
+      if (str=="dense") return dense();
+      if (str=="default") return fm_sampling();
+      if (str=="sparse") return sparse();
+      std::istringstream is(str);
+      uint64_t n;
+      if (!(is >> n) || !is.eof()) throw std::invalid_argument("invalid fm_index sampling: " + str);
+      return every(n);
+    }
+  };
+
+  //! \return the default name of the index file associated to a bwt file
+  inline std::string fm_index_filename(const std::string& bwt_filename) {return bwt_filename + ".fmi";}
+
+  //! \return the sampling of the marks saved in an index file by fm_index::save()
+  inline fm_sampling read_fm_index_sampling(const std::string& index_filename) {
+    std::ifstream is(index_filename,std::ios::binary);
+    if (!is) throw std::runtime_error("unable to open " + index_filename);
+    fm_index_header h;
+    if (!is.read(reinterpret_cast<char*>(&h),sizeof(h))) throw std::runtime_error("FM index file is not properly formatted: truncated header");
+    if (h.magic_number != fm_index_header::magic) throw std::runtime_error("FM index file is not properly formatted: the magic number provided in file header doesn't correspond to the expected one");
+    return fm_sampling(h.shift16,h.shift64);
+  }
+
+
 
   /*! \class fm_index
    *  \brief FM index with an internal run-length encoded Burrows Wheeler Transform string
-   *         To speed up random access, the class store one largeMark every 65536 indices, and one smallMark every 512
+   *         To speed up random access, the class store one largeMark every 65536 indices, and one smallMark every 128 (see fm_sampling)
+   *         MarkLayout is the policy storing the small marks, either split_marks or interleaved_marks.
    */
-  template <size_t AlphabetSize>
+  template <size_t AlphabetSize, template<size_t> class MarkLayout = split_marks>
   class fm_index {
   public:
     //
@@ -33,7 +117,14 @@ namespace bwt {
     //
     // constructors
     //
-    fm_index(const rle_string& bwt);
+    //! \brief build the index of the given bwt string. The string is moved into the index, that owns it.
+    //!        The marks are computed in parallel by num_threads threads.
+    fm_index(rle_string bwt, unsigned num_threads = default_num_threads(), fm_sampling sampling = fm_sampling());
+    
+    //! \brief load the marks of the bwt string from an index file previously written by save()
+    //!        The file is mapped in memory and used in place, the arguments populate and advice are given to mapped_file
+    //!        The sampling is the one of the saved index.
+    fm_index(rle_string bwt, const std::string& index_filename, bool populate = false, int advice = MADV_NORMAL);
 
     //
     // methods
@@ -44,6 +135,12 @@ namespace bwt {
     //! \return number of occurence of symbol c in bwt[0..i]
     inline alpha_count64 occ(const uint64_t i) const {return mark_at(i).counts;}
     
+    //! \return occ(.,i) and occ(.,j) with i<=j, for close positions the runs are scanned only once
+    inline std::pair<alpha_count64,alpha_count64> occ_pair(const uint64_t i, const uint64_t j) const {
+      auto m = mark_range(i,j);
+      return std::make_pair(m.first.counts,m.second.counts);
+    }
+    
     //! \brief the rle_string indexed by the object and storing the BWT
     const rle_string& bwt() const {return _bwt;}
     
@@ -60,16 +157,56 @@ namespace bwt {
     //! \return bwt[i], the ith character of bwt string
     inline uint8_t operator[](const uint64_t i) const {return _bwt.runs()[mark_at(i).run_index].value();}
     
+    //! \return the symbol c=bwt[i] and the row lf(i)[c]-1 of the suffix preceding the one of row i, with a single rank
+    inline std::pair<uint8_t,uint64_t> lf_step(const uint64_t i) const {
+      const auto m = mark_at(i);
+      const uint8_t c = _bwt.runs()[m.run_index].value();
+      return std::make_pair(c,_C[c] + m.counts[c] - 1);
+    }
+    
+    //! \brief prefetch the marks read by occ(i), so that the memory accesses of independent ranks overlap
+    inline void prefetch_marks(const uint64_t i) const {
+      __builtin_prefetch(&_marks64[i>>_sampling.shift64]);
+      __builtin_prefetch(&_marks16[i>>_sampling.shift16]);
+    }
+    
+    //! \brief prefetch the runs read by occ(i) in the run array, once its marks are in cache
+    //!         Nothing is done for the layouts holding a copy of the runs in the small marks.
+    inline void prefetch_runs(const uint64_t i) const {
+      if (layout_t::has_inline_runs) return;
+      const mark16_t& b = _marks16[i>>_sampling.shift16];
+      const run_t* run = _bwt.runs().begin() + _marks64[i>>_sampling.shift64].run_index + b.run_offset;
+      __builtin_prefetch(run);
+      __builtin_prefetch(run + 64);
+    }
+    
     //! \brief output debugging informations to the given stream
     void print_debug_info(std::ostream& os) const;
     
-  private:
-    //
-    // internal constants
-    //
-    static const uint8_t shift64 = 16;
-    static const uint8_t shift16 = 7;
+    //! \return the memory used by the marks, in bytes
+    size_t marks_bytes() const {return _marks64.size() * sizeof(mark64_t) + _marks16.size() * sizeof(mark16_t);}
+    
+    //! \return the sampling intervals of the marks
+    const fm_sampling& sampling() const {return _sampling;}
+    
+    //! \return the expected number of runs read by a rank at a random position: the runs covering half a small mark interval on average
+    double expected_scanned_runs() const {
+      return 1 + ((uint64_t(1)<<_sampling.shift16) - 1) / 2.0 / std::max(1.0,_bwt.avg_run_length());
+    }
+
+    //! \return the number of runs read by a rank at position i: the runs from the one of its checkpoint to the one containing i
+    uint64_t scanned_runs(const uint64_t i) const {
+      const mark16_t* b;
+      return mark_at(i).run_index - checkpoint(i,b).run_index + 1;
+    }
+    
+    //! \brief select the instruction set used to decode the runs, the best one supported by the cpu is used by default
+    void set_simd_level(simd_level level) {_simd_level = level; _skip_runs = skip_runs_kernel<AlphabetSize>(level);}
+    
+    //! \brief serialize the marks of the index into the given file, the bwt string itself is not saved
+    void save(const std::string& index_filename) const;
     
+  private:
     //
     // internal types
     //
@@ -82,41 +219,97 @@ namespace bwt {
       mark_t(T1 i):run_index(i) {}
     };
     typedef mark_t<uint64_t,alpha_count64> mark64_t;
-    typedef mark_t<uint16_t,alpha_count16> mark16_t;    
+    typedef MarkLayout<AlphabetSize> layout_t;
+    typedef typename layout_t::block_t mark16_t;
+    static_assert(std::is_trivially_copyable<mark64_t>::value && std::is_trivially_copyable<mark16_t>::value,"marks must be serializable");
     
     //
     // internal attributes
     //
-    std::vector<mark64_t> _marks64; // _marks64[i] stores the index I=run_index(bwt[k]) for k=i*65536, and occ(.,I)
-    std::vector<mark16_t> _marks16; // _marks16[i] stores the index I=run_index(bwt[k]) for k=i*512, and occ(.,I) expressed relatively to the preceeding _marks64
-    const rle_string& _bwt;
+    mapped_array<mark64_t> _marks64; // _marks64[i] stores the index I=run_index(bwt[k]) for k=i*65536, and occ(.,I)
+    mapped_array<mark16_t> _marks16; // _marks16[i] stores the index I=run_index(bwt[k]) for k=i*512, and occ(.,I) expressed relatively to the preceeding _marks64
+    rle_string _bwt;
     alpha_count64 _C;
+    fm_sampling _sampling;
+    simd_level _simd_level = detect_simd_level(); // instruction set of the run decoding kernel
+    skip_runs_fn _skip_runs = skip_runs_kernel<AlphabetSize>(_simd_level);
     
     //
     // internal methods
     //
     //! \return the run index containing symbol i and occ(.,i)
     inline mark64_t mark_at(const uint64_t i) const {
-    	// retreive the preeceding mark
-      auto m64 = _marks64[i>>shift64];
-      const auto& m16 = _marks16[i>>shift16];
-      m64.run_index += m16.run_index;
-      std::transform(m64.counts.begin(),m64.counts.end(),m16.counts.begin(),m64.counts.begin(),std::plus<uint64_t>());
-    	
-    	// interpolate the mark to the requested position
-      auto run = _bwt.runs().begin() + m64.run_index;
-      auto run_first = std::accumulate(m64.counts.begin(),m64.counts.end(),0);
-      while(true) {
-				auto run_len = run->length();
-				if (i < run_first + run_len) break;
-				run_first += run_len;
-				m64.counts[run->value()] += run_len;
-				++m64.run_index;
-				++run;
+      const mark16_t* b;
+      auto m = checkpoint(i,b);
+      const uint64_t block_run = m.run_index;
+      uint64_t run_first = std::accumulate(m.counts.begin(),m.counts.end(),uint64_t(0));
+      const run_t* run = scan_to(m,run_first,i,*b,block_run);
+      m.counts[run->value()] += (i+1-run_first);
+      return m;
+    }
+    
+    //! \return the marks at positions i and j, with i<=j
+    //!         When both positions are in the same block, the runs are scanned once from the checkpoint up to j.
+    inline std::pair<mark64_t,mark64_t> mark_range(const uint64_t i, const uint64_t j) const {
+      assert(i<=j);
+      if ((i>>_sampling.shift16) != (j>>_sampling.shift16)) {
+        // the checkpoint of j is closer than i
+        return std::make_pair(mark_at(i),mark_at(j));
       }
-      m64.counts[run->value()] += (i+1-run_first);
+      const mark16_t* b;
+      auto m = checkpoint(i,b);
+      const uint64_t block_run = m.run_index;
+      uint64_t run_first = std::accumulate(m.counts.begin(),m.counts.end(),uint64_t(0));
+      const run_t* run = scan_to(m,run_first,i,*b,block_run);
+      std::pair<mark64_t,mark64_t> r(m,m);
+      r.first.counts[run->value()] += (i+1-run_first);
+      run = scan_to(r.second,run_first,j,*b,block_run);
+      r.second.counts[run->value()] += (j+1-run_first);
+      return r;
+    }
+    
+    //! \return the mark of the checkpoint preceeding position i: the run containing the checkpoint, and occ(.,.) before that run
+    //!         b is set to the block of the checkpoint
+    inline mark64_t checkpoint(const uint64_t i, const mark16_t*& b) const {
+      auto m64 = _marks64[i>>_sampling.shift64];
+      b = &_marks16[i>>_sampling.shift16];
+      m64.run_index += b->run_offset;
+      std::transform(m64.counts.begin(),m64.counts.end(),b->counts.begin(),m64.counts.begin(),std::plus<uint64_t>());
       return m64;
     }
+    
+    //! \brief move the mark m, referencing the run starting at position run_first, forward to the run containing position i
+    //!         The copy of the runs held by the block b, whose first run is block_run, is read before the run array.
+    //! \return the run containing position i
+    inline const run_t* scan_to(mark64_t& m, uint64_t& run_first, const uint64_t i, const mark16_t& b, const uint64_t block_run) const {
+      size_t n;
+      const run_t* cached = layout_t::inline_runs(b,n);
+      const uint64_t offset = m.run_index - block_run;
+      if (offset < n) {
+        const run_t* run = scan_runs(cached + offset,n - offset,m,run_first,i);
+        if (run) return run;
+      }
+      const auto runs = _bwt.runs();
+      return scan_runs(runs.begin() + m.run_index,runs.size() - m.run_index,m,run_first,i);
+    }
+    
+    //! \brief move the mark m forward over the runs [first,first+n) up to the run containing position i
+    //! \return the run containing position i, or nullptr when it is after these runs
+    inline const run_t* scan_runs(const run_t* first, const size_t n, mark64_t& m, uint64_t& run_first, const uint64_t i) const {
+      // skip blocks of runs with the vectorized kernel, then finish run by run
+      size_t k = _skip_runs(first,n,i - run_first,m.counts.data(),run_first);
+      for(;k<n;++k) {
+				auto run_len = first[k].length();
+				if (i < run_first + run_len) {
+					m.run_index += k;
+					return first + k;
+				}
+				run_first += run_len;
+				m.counts[first[k].value()] += run_len;
+      }
+      m.run_index += n;
+      return nullptr;
+    }
   };
   
   
@@ -131,25 +324,87 @@ namespace bwt {
   //
   ////////////////////////////////////////////////
 
-  template <size_t AlphabetSize>
-  fm_index<AlphabetSize>::fm_index(const rle_string& bwt): _bwt(bwt) {
-    _marks64.reserve((bwt.size()>>shift64) + 1);
-    _marks16.reserve((bwt.size()>>shift16) + 1);
+  template <size_t AlphabetSize, template<size_t> class MarkLayout>
+  fm_index<AlphabetSize,MarkLayout>::fm_index(rle_string bwt, unsigned num_threads, fm_sampling sampling): _bwt(std::move(bwt)), _sampling(sampling) {
+    const auto runs = _bwt.runs();
+    const uint64_t mask64 = (uint64_t(1)<<_sampling.shift64) - 1;
+    const uint64_t mask16 = (uint64_t(1)<<_sampling.shift16) - 1;
+    typename mapped_array<mark64_t>::vector_type marks64((_bwt.size() + mask64)>>_sampling.shift64,mark64_t(0));
+    typename mapped_array<mark16_t>::vector_type marks16((_bwt.size() + mask16)>>_sampling.shift16);
     
+    // the run array is split in chunks processed in parallel
+    struct chunk_t {
+      size_t first_run,last_run;
+      uint64_t first_pos;    // position of the first symbol of the chunk
+      alpha_count64 counts;  // occurence of the symbols before the chunk
+      std::vector< std::pair<uint64_t,mark64_t> > pending; // marks16 whose mark64 is in a preceeding chunk, with absolute counts
+    };
+    const size_t num_chunks = std::max<size_t>(1,std::min<size_t>(num_threads,runs.size()>>16));
+    std::vector<chunk_t> chunks(num_chunks);
+    for(size_t c=0;c<num_chunks;++c) {
+      chunks[c].first_run = runs.size() * c / num_chunks;
+      chunks[c].last_run = runs.size() * (c+1) / num_chunks;
+    }
+    
+    // count the symbols of each chunk
+    parallel_for(num_chunks,num_threads,[&](size_t c) {
+      std::array<uint64_t,256> hist;
+      hist.fill(0);
+      for(size_t r=chunks[c].first_run;r<chunks[c].last_run;++r) ++hist[runs[r]._data];
+      chunks[c].counts.fill(0);
+      run_t run;
+      for(size_t b=0;b<hist.size();++b) {
+        run._data = b;
+        if (hist[b]) chunks[c].counts[run.value()] += hist[b] * run.length();
+      }
+    });
+    
+    // prefix sum over the chunks gives their starting position and counts
     std::fill(_C.begin(),_C.end(),0);
-    uint64_t run_index=0;
-    uint64_t run_pos=0;
-    for(auto run:bwt.runs()) {
-      if (run_pos >= _marks64.size()<<shift64) _marks64.push_back(mark64_t(run_index,C()));
-      if (run_pos >= _marks16.size()<<shift16) {
-				_marks16.push_back(mark16_t(run_index - _marks64.back().run_index));
-				std::transform(_C.begin(),_C.end(),_marks64.back().counts.begin(),_marks16.back().counts.begin(),std::minus<uint64_t>());
+    uint64_t pos = 0;
+    for(auto& chunk:chunks) {
+      auto n = chunk.counts;
+      chunk.counts = _C;
+      chunk.first_pos = pos;
+      std::transform(_C.begin(),_C.end(),n.begin(),_C.begin(),std::plus<uint64_t>());
+      pos += std::accumulate(n.begin(),n.end(),uint64_t(0));
+    }
+    
+    // a mark references the run containing its first position, so that mark_at() never starts past i
+    auto set_mark16 = [&](mark16_t& b,const mark64_t& m,const mark64_t& m64) {
+      alpha_count16 counts;
+      std::transform(m.counts.begin(),m.counts.end(),m64.counts.begin(),counts.begin(),std::minus<uint64_t>());
+      layout_t::make_block(b,m.run_index - m64.run_index,counts,runs.begin() + m.run_index,runs.size() - m.run_index);
+    };
+    parallel_for(num_chunks,num_threads,[&](size_t c) {
+      auto& chunk = chunks[c];
+      mark64_t m(chunk.first_run,chunk.counts);
+      uint64_t run_end = chunk.first_pos;
+      for(;m.run_index<chunk.last_run;++m.run_index) {
+        const auto run = runs[m.run_index];
+        const uint64_t run_first = run_end;
+        run_end += run.length();
+        for(uint64_t k=(run_first + mask64)>>_sampling.shift64;(k<<_sampling.shift64) < run_end;++k) marks64[k] = m;
+        for(uint64_t k=(run_first + mask16)>>_sampling.shift16;(k<<_sampling.shift16) < run_end;++k) {
+          const uint64_t k64 = k>>(_sampling.shift64-_sampling.shift16);
+          if ((k64<<_sampling.shift64) >= chunk.first_pos) {
+            set_mark16(marks16[k],m,marks64[k64]);
+          } else {
+            chunk.pending.push_back(std::make_pair(k,m));
+          }
+        }
+        m.counts[run.value()] += run.length();
       }
-      _C[run.value()] += run.length();
-      run_pos += run.length();
-      ++run_index;
+    });
+    
+    // fix up the marks16 of the chunk heads, now that all marks64 are known
+    for(const auto& chunk:chunks) {
+      for(const auto& p:chunk.pending) set_mark16(marks16[p.first],p.second,marks64[p.first>>(_sampling.shift64-_sampling.shift16)]);
     }
     
+    _marks64 = mapped_array<mark64_t>(std::move(marks64));
+    _marks16 = mapped_array<mark16_t>(std::move(marks16));
+    
     // C[c] is the count symbol c in bwt string
     // transform it into the count of lexicography smaller symbols [0..c)
     uint64_t s = 0;
@@ -158,15 +413,73 @@ namespace bwt {
       i = s;
       s += v;
     }
-    assert(bwt.size()==s);
+    assert(_bwt.size()==s);
+  }
+  
+
+  template <size_t AlphabetSize, template<size_t> class MarkLayout>
+  fm_index<AlphabetSize,MarkLayout>::fm_index(rle_string bwt, const std::string& index_filename, bool populate, int advice): _bwt(std::move(bwt)) {
+    auto map = std::make_shared<const mapped_file>(index_filename,populate,advice);
+    fm_index_header h;
+    if (map->size() < sizeof(h) + sizeof(_C)) throw std::runtime_error("FM index file is not properly formatted: truncated header");
+    std::memcpy(&h,map->data(),sizeof(h));
+    if (h.magic_number != fm_index_header::magic) throw std::runtime_error("FM index file is not properly formatted: the magic number provided in file header doesn't correspond to the expected one");
+    if (h.version != fm_index_header::current_version) throw std::runtime_error("FM index file version is not supported");
+    if (h.alphabet_size != AlphabetSize || h.layout != layout_t::id || h.mark64_size != sizeof(mark64_t) || h.mark16_size != sizeof(mark16_t)) {
+      throw std::runtime_error("FM index file has been built with incompatible parameters");
+    }
+    if (h.bwt_size != _bwt.size() || h.num_runs != _bwt.runs().size()) throw std::runtime_error("FM index file doesn't correspond to the BWT string");
+    
+    _sampling = fm_sampling(h.shift16,h.shift64);
+    std::memcpy(_C.data(),map->data()+sizeof(h),sizeof(_C));
+    _marks64 = mapped_array<mark64_t>(map,h.marks64_offset,h.num_marks64);
+    _marks16 = mapped_array<mark16_t>(map,h.marks16_offset,h.num_marks16);
+  }
+  
+
+  template <size_t AlphabetSize, template<size_t> class MarkLayout>
+  void fm_index<AlphabetSize,MarkLayout>::save(const std::string& index_filename) const {
+    fm_index_header h;
+    std::memset(&h,0,sizeof(h));
+    h.magic_number = fm_index_header::magic;
+    h.version = fm_index_header::current_version;
+    h.alphabet_size = AlphabetSize;
+    h.shift64 = _sampling.shift64;
+    h.shift16 = _sampling.shift16;
+    h.layout = layout_t::id;
+    h.mark64_size = sizeof(mark64_t);
+    h.mark16_size = sizeof(mark16_t);
+    h.bwt_size = _bwt.size();
+    h.num_runs = _bwt.runs().size();
+    h.num_marks64 = _marks64.size();
+    h.num_marks16 = _marks16.size();
+    h.marks64_offset = fm_index_header::align(sizeof(h) + sizeof(_C));
+    h.marks16_offset = fm_index_header::align(h.marks64_offset + _marks64.size() * sizeof(mark64_t));
+    
+    std::ofstream os(index_filename,std::ios::binary);
+    if (!os) throw std::runtime_error("unable to create " + index_filename);
+    auto pad_to = [&](uint64_t offset) {while ((uint64_t) os.tellp() < offset) os.put(0);};
+    os.write(reinterpret_cast<const char*>(&h),sizeof(h));
+    os.write(reinterpret_cast<const char*>(_C.data()),sizeof(_C));
+    pad_to(h.marks64_offset);
+    os.write(reinterpret_cast<const char*>(_marks64.data()),_marks64.size() * sizeof(mark64_t));
+    pad_to(h.marks16_offset);
+    os.write(reinterpret_cast<const char*>(_marks16.data()),_marks16.size() * sizeof(mark16_t));
+    if (!os) throw std::runtime_error("error while writing " + index_filename);
   }
   
 
-  template <size_t AlphabetSize>
-  void fm_index<AlphabetSize>::print_debug_info(std::ostream& os) const {
+  template <size_t AlphabetSize, template<size_t> class MarkLayout>
+  void fm_index<AlphabetSize,MarkLayout>::print_debug_info(std::ostream& os) const {
 		_bwt.print_debug_info(os);
+    os << "simd:" << simd_level_name(_simd_level) << std::endl;
+    os << "layout:" << layout_t::name() << std::endl;
+    os << "sampling:" << (uint64_t(1)<<_sampling.shift64) << '/' << (uint64_t(1)<<_sampling.shift16) << std::endl;
     os << "#marks64:" << _marks64.size() << " (" << (double) _marks64.size() * sizeof(mark64_t)/1024/1024 << "Mo)" << std::endl;
     os << "#marks16:" << _marks16.size() << " (" << (double) _marks16.size() * sizeof(mark16_t)/1024/1024 << "Mo)" << std::endl;
+    const double n = std::max<uint64_t>(1,_bwt.size());
+    os << "bytes/symbol:" << (_bwt.runs().size() * sizeof(run_t) + marks_bytes()) / n << " (runs:" << _bwt.runs().size() * sizeof(run_t) / n << ", marks:" << marks_bytes() / n << ")" << std::endl;
+    os << "expected runs scanned/query:" << expected_scanned_runs() << std::endl;
   }
   
 };
@@ -0,0 +1,103 @@
+#ifndef KMERTABLE_H
+#define KMERTABLE_H
+
+#include <cinttypes>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstring>
+
+#include "mapped_file.h"
+
+namespace bwt {
+
+
+  /*! \struct kmer_table_header
+   *  \brief header of the binary k-mer tables written by kmer-count --binary
+   *         The header is followed by one record per canonical k-mer: the k-mer packed 2 bits per base (A,C,G,T as 0..3),
+   *         the first base in the highest bits, on kmer_bytes(kmer_length) bytes, then the forward and reverse counts
+   *         of the k-mer in each file, as LEB128 varints.
+   */
+  struct kmer_table_header {
+    enum {magic = 0x52454D4B, current_version = 1}; // "KMER"
+    uint32_t magic_number;
+    uint16_t version;
+    uint16_t kmer_length;
+    uint32_t num_files;
+    uint32_t reserved;
+  };
+
+  //! \return number of bytes of a packed k-mer
+  inline size_t kmer_bytes(size_t k) {return (2*k + 7) / 8;}
+
+  //! \brief append to out the k-mer given as bases 0..3, packed 2 bits per base
+  inline void append_packed_kmer(std::string& out, const std::string& kmer) {
+    uint8_t byte = 0;
+    for(size_t i=0;i<kmer.size();++i) {
+      byte = (byte<<2) | (kmer[i] & 3);
+      if (i%4==3) {
+        out.push_back(byte);
+        byte = 0;
+      }
+    }
+    if (kmer.size()%4) out.push_back(byte << (2*(4 - kmer.size()%4)));
+  }
+
+  //! \brief append to out the LEB128 varint encoding of v: 7 bits per byte, the high bit set on all bytes but the last
+  inline void append_varint(std::string& out, uint64_t v) {
+    for(;v>=0x80;v>>=7) out.push_back(0x80 | (v & 0x7F));
+    out.push_back(v);
+  }
+
+
+
+  /*! \class kmer_table_reader
+   *  \brief sequential reader of a binary k-mer table mapped in memory
+   */
+  class kmer_table_reader {
+  public:
+    //! \brief map the given table in memory and check its header
+    kmer_table_reader(const std::string& filename): _map(std::make_shared<const mapped_file>(filename,false,MADV_SEQUENTIAL)) {
+      if (_map->size() < sizeof(_h)) throw std::runtime_error("k-mer table is not properly formatted: truncated header");
+      std::memcpy(&_h,_map->data(),sizeof(_h));
+      if (_h.magic_number != kmer_table_header::magic) throw std::runtime_error("k-mer table is not properly formatted: the magic number provided in file header doesn't correspond to the expected one");
+      if (_h.version != kmer_table_header::current_version) throw std::runtime_error("k-mer table version is not supported");
+      _p = _map->data() + sizeof(_h);
+      _end = _map->data() + _map->size();
+    }
+
+    //! \return the header of the table
+    const kmer_table_header& header() const {return _h;}
+
+    //! \brief read the next record: the k-mer as bases 0..3, and the forward and reverse counts in each file
+    //! \return false at the end of the table
+    bool next(std::string& kmer, std::vector<uint64_t>& counts) {
+      if (_p == _end) return false;
+      const size_t n = kmer_bytes(_h.kmer_length);
+      if ((size_t) (_end - _p) < n) throw std::runtime_error("k-mer table is not properly formatted: truncated record");
+      kmer.resize(_h.kmer_length);
+      for(size_t i=0;i<kmer.size();++i) kmer[i] = (_p[i/4] >> (2*(3 - i%4))) & 3;
+      _p += n;
+      counts.resize(2 * _h.num_files);
+      for(auto& c:counts) {
+        c = 0;
+        for(unsigned shift=0;;shift+=7) {
+          if (_p == _end || shift >= 64) throw std::runtime_error("k-mer table is not properly formatted: truncated record");
+          const uint8_t b = *_p++;
+          c |= uint64_t(b & 0x7F) << shift;
+          if (!(b & 0x80)) break;
+        }
+      }
+      return true;
+    }
+
+  private:
+    mapped_file_ptr _map;
+    kmer_table_header _h;
+    const uint8_t* _p;
+    const uint8_t* _end;
+  };
+
+};
+
+#endif
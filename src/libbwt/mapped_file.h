@@ -0,0 +1,150 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cinttypes>
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace bwt {
+
+
+	/*! \class mapped_file
+	 *  \brief read-only memory mapping of a whole file
+	 *         The mapping is shared between the processes mapping the same file, so that
+	 *         they all use the same pages of the system page cache.
+	 */
+	class mapped_file {
+	public:
+		//! \brief map the given file in memory
+		//! \param populate  prefault the pages of the mapping (MAP_POPULATE)
+		//! \param advice    madvise() hint on the expected access pattern
+		mapped_file(const std::string& filename, bool populate = false, int advice = MADV_NORMAL);
+		~mapped_file() {if (_size) munmap(_data,_size);}
+		mapped_file(const mapped_file&) = delete;
+		mapped_file& operator=(const mapped_file&) = delete;
+
+		//! \return pointer on the first byte of the file
+		inline const uint8_t* data() const {return static_cast<const uint8_t*>(_data);}
+
+		//! \return size of the file in bytes
+		inline size_t size() const {return _size;}
+
+		//! \brief drop the pages of the mapping from the memory of the process, they are read again from the file when
+		//!        accessed
+		void release() const {if (_size) madvise(_data,_size,MADV_DONTNEED);}
+
+	private:
+		void* _data = nullptr;
+		size_t _size = 0;
+	};
+
+	typedef std::shared_ptr<const mapped_file> mapped_file_ptr;
+
+
+
+	/*! \class cache_aligned_allocator
+	 *  \brief allocator returning memory aligned on cache lines, for the over-aligned types that std::allocator doesn't honor in C++11
+	 */
+	template<typename T>
+	struct cache_aligned_allocator {
+		typedef T value_type;
+		enum {alignment = 64};
+		cache_aligned_allocator() {}
+		template<typename U> cache_aligned_allocator(const cache_aligned_allocator<U>&) {}
+		T* allocate(size_t n) {
+			void* p = nullptr;
+			if (posix_memalign(&p,alignment,n*sizeof(T)) != 0) throw std::bad_alloc();
+			return static_cast<T*>(p);
+		}
+		void deallocate(T* p, size_t) {free(p);}
+	};
+	template<typename T,typename U> bool operator==(const cache_aligned_allocator<T>&,const cache_aligned_allocator<U>&) {return true;}
+	template<typename T,typename U> bool operator!=(const cache_aligned_allocator<T>&,const cache_aligned_allocator<U>&) {return false;}
+
+
+
+	/*! \class mapped_array
+	 *  \brief read-only array of trivially copyable elements, either owned in memory or viewed in a mapped file
+	 */
+	template<typename T>
+	class mapped_array {
+	public:
+		typedef const T* const_iterator;
+		typedef std::vector<T,cache_aligned_allocator<T> > vector_type;
+		
+		//! \brief construct an empty array
+		mapped_array() {}
+		
+		//! \brief construct an array owning the given elements
+		mapped_array(vector_type v):_vec(std::move(v)) {}
+		
+		//! \brief construct a view over n elements stored in the mapping at the given byte offset
+		mapped_array(mapped_file_ptr map,size_t offset,size_t n):_map(std::move(map)),_offset(offset),_n(n) {
+			if (_offset + _n*sizeof(T) > _map->size()) throw std::runtime_error("mapped_array: out of the bounds of the mapped file");
+		}
+		
+		inline const T* data() const {return _map ? reinterpret_cast<const T*>(_map->data() + _offset) : _vec.data();}
+		inline size_t size() const {return _map ? _n : _vec.size();}
+		inline bool empty() const {return size()==0;}
+		inline const_iterator begin() const {return data();}
+		inline const_iterator end() const {return data() + size();}
+		inline const T& operator[](size_t i) const {return data()[i];}
+		inline const T& back() const {return data()[size()-1];}
+		
+		//! \return true when the elements are read from a mapped file
+		inline bool mapped() const {return static_cast<bool>(_map);}
+		
+	private:
+		vector_type _vec;
+		mapped_file_ptr _map;
+		size_t _offset = 0;
+		size_t _n = 0;
+	};
+
+
+
+  ////////////////////////////////////////////////
+  //
+  // mapped_file class implementation
+  //
+  ////////////////////////////////////////////////
+
+	inline mapped_file::mapped_file(const std::string& filename, bool populate, int advice) {
+		int fd = open(filename.c_str(),O_RDONLY);
+		if (fd<0) throw std::runtime_error("unable to open " + filename + ": " + std::strerror(errno));
+		struct stat st;
+		if (fstat(fd,&st)<0) {
+			close(fd);
+			throw std::runtime_error("unable to stat " + filename + ": " + std::strerror(errno));
+		}
+		if (st.st_size > 0) {
+			int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+			if (populate) flags |= MAP_POPULATE;
+#endif
+			void* p = mmap(nullptr,st.st_size,PROT_READ,flags,fd,0);
+			if (p == MAP_FAILED) {
+				close(fd);
+				throw std::runtime_error("unable to map " + filename + ": " + std::strerror(errno));
+			}
+			_data = p;
+			_size = st.st_size;
+			if (advice != MADV_NORMAL) madvise(_data,_size,advice);
+		}
+		close(fd);
+	}
+
+};
+
+#endif
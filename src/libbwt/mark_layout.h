@@ -0,0 +1,80 @@
+#ifndef MARKLAYOUT_H
+#define MARKLAYOUT_H
+
+#include <cinttypes>
+#include <array>
+#include <algorithm>
+
+#include "rle.h"
+
+namespace bwt {
+
+
+	/*! \class split_marks
+	 *  \brief layout of the fm_index small marks: each block only stores the run offset and the 16-bit counts
+	 *         relative to the large mark. The runs are read from the rle_string.
+	 *         A rank touches the large marks, the small marks and the run array.
+	 */
+	template<size_t AlphabetSize>
+	struct split_marks {
+		enum {id = 0, has_inline_runs = 0};
+		struct block_t {
+			uint16_t run_offset;
+			std::array<uint16_t,AlphabetSize> counts;
+		};
+		
+		//! \return printable name of the layout
+		static const char* name() {return "split";}
+		
+		//! \brief fill the block b of a mark referencing the run runs[0], n being the number of runs available from there
+		static inline void make_block(block_t& b, uint16_t run_offset, const std::array<uint16_t,AlphabetSize>& counts, const run_t*, size_t) {
+			b.run_offset = run_offset;
+			b.counts = counts;
+		}
+		
+		//! \return the copy of the runs stored in the block, starting at the run referenced by the block, and their number in n
+		static inline const run_t* inline_runs(const block_t&, size_t& n) {
+			n = 0;
+			return nullptr;
+		}
+	};
+
+
+	/*! \class interleaved_marks
+	 *  \brief layout of the fm_index small marks in cache lines: each 64 bytes block stores the run offset and the 16-bit counts
+	 *         relative to the large mark, followed by a copy of the first runs it covers.
+	 *         With the large marks small enough to stay in cache, a typical rank touches a single cache line.
+	 */
+	template<size_t AlphabetSize>
+	struct interleaved_marks {
+		enum {id = 1, has_inline_runs = 1, capacity = 64 - sizeof(uint16_t)*(AlphabetSize+1) - sizeof(uint8_t)};
+		struct alignas(64) block_t {
+			uint16_t run_offset;
+			std::array<uint16_t,AlphabetSize> counts;
+			uint8_t num_runs;
+			run_t runs[capacity];
+		};
+		static_assert(sizeof(block_t)==64,"a block must fill exactly one cache line");
+		
+		//! \return printable name of the layout
+		static const char* name() {return "interleaved";}
+		
+		//! \brief fill the block b of a mark referencing the run runs[0], n being the number of runs available from there
+		static inline void make_block(block_t& b, uint16_t run_offset, const std::array<uint16_t,AlphabetSize>& counts, const run_t* runs, size_t n) {
+			b.run_offset = run_offset;
+			b.counts = counts;
+			b.num_runs = std::min<size_t>(n,capacity);
+			std::copy(runs,runs+b.num_runs,b.runs);
+			std::fill(b.runs+b.num_runs,b.runs+capacity,run_t());
+		}
+		
+		//! \return the copy of the runs stored in the block, starting at the run referenced by the block, and their number in n
+		static inline const run_t* inline_runs(const block_t& b, size_t& n) {
+			n = b.num_runs;
+			return b.runs;
+		}
+	};
+
+};
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef MERGE_H
+#define MERGE_H
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <cinttypes>
+
+#include "rle.h"
+#include "parallel.h"
+#include "fm_index.h"
+#include "packed_index.h"
+#include "bcr.h"
+
+namespace bwt {
+
+
+  /*! \brief interleave of the rows of the bwts of two collections a and b in the bwt of their concatenation, the strings
+   *         of b following the ones of a
+   *         Bit i is set when row i of the merged bwt comes from b. The suffixes of a string of b are placed by walking it
+   *         backward with LF steps in b, while its rank among the suffixes of a is extended by backward search in a: the
+   *         number of suffixes of a smaller than cS is C[c] plus the number of c before the rank of S in the bwt of a, the
+   *         suffixes of a equal to S being smaller as their strings come first. The walks are distributed to num_threads
+   *         threads by chunks of strings, and extended in lock-step by batches with prefetching as in extract_batch().
+   */
+  template<typename IndexA, typename IndexB>
+  std::vector<uint64_t> merge_interleave(const IndexA& a, const IndexB& b, unsigned num_threads = default_num_threads(), size_t batch_size = 32) {
+    const uint64_t n = a.bwt().size() + b.bwt().size();
+    const uint64_t num_strings_a = a.C()[1], num_strings_b = b.C()[1];
+    std::vector<uint64_t> words((n + 63) / 64,0);
+
+    struct walk_t {uint64_t row, rank, steps;}; // row in b, and rank among the suffixes of a
+    const size_t num_chunks = std::min<uint64_t>(num_strings_b,64 * (uint64_t) num_threads);
+    parallel_for(num_chunks,num_threads,[&](size_t k) {
+      std::vector<walk_t> walks;
+      std::vector<size_t> active;
+      const uint64_t first = num_strings_b * k / num_chunks, last = num_strings_b * (k+1) / num_chunks;
+      for(uint64_t s=first;s<last;s+=batch_size) {
+        // the suffix "$" of string s of b follows the ones of all the strings of a
+        walks.clear();
+        active.clear();
+        for(uint64_t t=s;t<std::min(last,s+batch_size);++t) {
+          walks.push_back(walk_t{t,num_strings_a,0});
+          active.push_back(active.size());
+          b.prefetch_marks(t);
+          if (num_strings_a) a.prefetch_marks(num_strings_a - 1);
+        }
+        while (!active.empty()) {
+          for(auto j:active) {
+            b.prefetch_runs(walks[j].row);
+            if (walks[j].rank) a.prefetch_runs(walks[j].rank - 1);
+          }
+          size_t m = 0;
+          for(auto j:active) {
+            walk_t& w = walks[j];
+            const uint64_t i = w.rank + w.row;
+            __atomic_fetch_or(&words[i/64],uint64_t(1) << (i%64),__ATOMIC_RELAXED);
+            const auto step = b.lf_step(w.row);
+            if (step.first==0) continue;
+            if (++w.steps > b.bwt().size()) throw std::runtime_error("merge_interleave: the bwt string is not a collection of strings");
+            w.rank = a.C()[step.first] + (w.rank ? a.occ(w.rank - 1)[step.first] : 0);
+            w.row = step.second;
+            b.prefetch_marks(w.row);
+            if (w.rank) a.prefetch_marks(w.rank - 1);
+            active[m++] = j;
+          }
+          active.resize(m);
+        }
+      }
+    });
+    return words;
+  }
+
+
+  /*! \brief merge the bwts of two collections without sorting their suffixes again: the result is the bwt of the
+   *         strings of a followed by the strings of b
+   *         The runs of a and b are copied in the order given by merge_interleave(), whose LF walks are done in parallel.
+   */
+  template<typename IndexA, typename IndexB>
+  rle_string merge_bwt(const IndexA& a, const IndexB& b, unsigned num_threads = default_num_threads()) {
+    const std::vector<uint64_t> words = merge_interleave(a,b,num_threads);
+    const uint64_t n = a.bwt().size() + b.bwt().size();
+
+    // cursor in the runs of a string, copying its symbols to the merged string
+    struct cursor_t {
+      run_span runs;
+      size_t i;
+      uint8_t used;
+      void copy(rle_string& out, uint64_t len) {
+        while (len) {
+          if (i==runs.size()) throw std::runtime_error("merge_bwt: the interleave doesn't match the bwt strings");
+          const run_t r = runs[i];
+          const uint8_t k = std::min<uint64_t>(len,r.length() - used);
+          out.append(r.value(),k);
+          len -= k;
+          used += k;
+          if (used==r.length()) {++i;used = 0;}
+        }
+      }
+    };
+    cursor_t ca{a.bwt().runs(),0,0}, cb{b.bwt().runs(),0,0};
+
+    // copy the stretches of rows coming from the same string
+    rle_string out;
+    for(uint64_t i=0;i<n;) {
+      const bool from_b = (words[i/64] >> (i%64)) & 1;
+      uint64_t j = i;
+      while (j<n) {
+        const uint64_t w = (from_b ? ~words[j/64] : words[j/64]) >> (j%64);
+        if (w) {j += __builtin_ctzll(w);break;}
+        j += 64 - j%64;
+      }
+      j = std::min(j,n);
+      (from_b ? cb : ca).copy(out,j - i);
+      i = j;
+    }
+    return out;
+  }
+
+
+  /*! \brief append a batch of strings to the collection of a bwt without sorting its suffixes again
+   *         The bwt of the batch is built with bcr_build() from text, the concatenation of the strings each followed by a
+   *         sentinel 0 and made of the symbols A, C, G and T coded 1 to 4, and merged after the strings of a. The batch is
+   *         indexed with a packed_dna_index, whose ranks don't depend on the length of the runs.
+   */
+  template<typename Index>
+  rle_string append_strings(const Index& a, const std::string& text, unsigned num_threads = default_num_threads()) {
+    const packed_dna_index b(bcr_build(text,num_threads),num_threads);
+    return merge_bwt(a,b,num_threads);
+  }
+
+};
+
+#endif
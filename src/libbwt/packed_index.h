@@ -0,0 +1,233 @@
+#ifndef PACKEDINDEX_H
+#define PACKEDINDEX_H
+
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include <cassert>
+#include <array>
+#include <iostream>
+#include <cinttypes>
+
+#include "rle.h"
+#include "mapped_file.h"
+#include "parallel.h"
+#include "simd.h"
+
+namespace bwt {
+
+
+  /*! \class packed_dna_index
+   *  \brief occurence index of a DNA bwt string (alphabet $ACGT) storing the symbols uncompressed, 2 bits per symbol
+   *         The symbols are stored in cache line blocks of 192 symbols, interleaved with the occurences before the block
+   *         (as done by BWA), so that occ() reads a single block and counts the symbols of the block with popcounts.
+   *         '$' is packed as 'A', the positions of the '$' being kept aside in a sorted array.
+   *         This index is faster and smaller than fm_index when the runs of the bwt are short (high entropy, low coverage).
+   *         The runs of the rle_string are no longer read once the index is built: when the string is mapped from a file,
+   *         its pages are dropped from the memory of the process. Otherwise they stay in memory next to the blocks.
+   */
+  class packed_dna_index {
+  public:
+    //
+    // public types definitions
+    //
+    //! \brief define an array of numbers for each alphabet character
+    typedef std::array<uint64_t,5> alpha_count64;
+
+    //
+    // constructors
+    //
+    //! \brief build the index of the given bwt string. The string is moved into the index, that owns it.
+    //!        The occurences are counted in parallel by num_threads threads.
+    packed_dna_index(rle_string bwt, unsigned num_threads = default_num_threads());
+
+    //
+    // methods
+    //
+    //! \return size of the alphabet
+    size_t alphabet_size() const {return 5;}
+
+    //! \return number of occurence of symbol c in bwt[0..i]
+    inline alpha_count64 occ(const uint64_t i) const {
+      const uint64_t b = i / block_size;
+      const uint64_t r = i - b * block_size;
+      const block_t& blk = _blocks[b];
+      const alpha_count64& sb = _superblocks[b>>superblock_shift];
+      uint64_t codes[4] = {0,0,0,0};
+      _count_codes(blk.symbols,r+1,codes);
+      alpha_count64 n;
+      n[0] = sb[0] + blk.counts[0];
+      for(size_t c=1;c<5;++c) n[c] = sb[c] + blk.counts[c] + codes[c-1];
+      if (blk.num_dollars) {
+        // the '$' of the block up to i were counted as 'A'
+        const uint64_t* d = _dollars.data() + n[0];
+        uint64_t k = 0;
+        while (k<blk.num_dollars && d[k]<=i) ++k;
+        n[0] += k;
+        n[1] -= k;
+      }
+      return n;
+    }
+
+    //! \return occ(.,i) and occ(.,j) with i<=j
+    inline std::pair<alpha_count64,alpha_count64> occ_pair(const uint64_t i, const uint64_t j) const {return std::make_pair(occ(i),occ(j));}
+
+    //! \brief the rle_string indexed by the object and storing the BWT, whose runs are not read by the index
+    const rle_string& bwt() const {return _bwt;}
+
+    //! \brief number of occurence of symbols [0..c) in bwt string.
+    const alpha_count64& C() const {return _C;}
+
+    //! \return last to first mapping at position i for all characters of the alphabet
+    inline alpha_count64 lf(const uint64_t i) const {
+      auto n(occ(i));
+      std::transform(n.begin(),n.end(),C().begin(),n.begin(),std::plus<uint64_t>());
+      return n;
+    }
+
+    //! \return bwt[i], the ith character of bwt string
+    inline uint8_t operator[](const uint64_t i) const {
+      const uint64_t b = i / block_size;
+      const uint64_t r = i - b * block_size;
+      const block_t& blk = _blocks[b];
+      const uint8_t code = (blk.symbols[r/32] >> (2*(r%32))) & 3;
+      if (code==0 && blk.num_dollars) {
+        const uint64_t* d = _dollars.data() + _superblocks[b>>superblock_shift][0] + blk.counts[0];
+        if (std::find(d,d+blk.num_dollars,i) != d+blk.num_dollars) return 0;
+      }
+      return code + 1;
+    }
+
+    //! \return the symbol c=bwt[i] and the row lf(i)[c]-1 of the suffix preceding the one of row i, both read from the same block
+    inline std::pair<uint8_t,uint64_t> lf_step(const uint64_t i) const {
+      const uint8_t c = (*this)[i];
+      return std::make_pair(c,_C[c] + occ(i)[c] - 1);
+    }
+
+    //! \brief prefetch the block read by occ(i), so that the memory accesses of independent ranks overlap
+    inline void prefetch_marks(const uint64_t i) const {__builtin_prefetch(&_blocks[i / block_size]);}
+    
+    //! \brief nothing to do: the symbols are in the block of the counts
+    inline void prefetch_runs(const uint64_t) const {}
+
+    //! \brief output debugging informations to the given stream
+    void print_debug_info(std::ostream& os) const;
+
+    //! \return the memory used by the packed symbols and their occurences, in bytes
+    size_t marks_bytes() const {return _blocks.size() * sizeof(block_t) + _superblocks.size() * sizeof(alpha_count64) + _dollars.size() * sizeof(uint64_t);}
+
+    //! \brief select the instruction set used to count the symbols, the best one supported by the cpu is used by default
+    void set_simd_level(simd_level level) {_simd_level = level; _count_codes = count_codes_kernel(level);}
+
+  private:
+    //
+    // internal types
+    //
+    enum {block_size = 192, superblock_shift = 8}; // a superblock of 256 blocks spans less than 65536 symbols
+    struct alignas(64) block_t {
+      std::array<uint16_t,5> counts; // occurences before the block, relative to the superblock
+      uint16_t num_dollars;          // number of '$' in the block
+      uint32_t reserved;
+      uint64_t symbols[block_size/32];
+    };
+    static_assert(sizeof(block_t)==64,"a block is a cache line");
+
+    //
+    // internal attributes
+    //
+    std::vector<block_t,cache_aligned_allocator<block_t> > _blocks;
+    std::vector<alpha_count64> _superblocks; // occurences before each superblock
+    std::vector<uint64_t> _dollars;          // positions of the '$'
+    rle_string _bwt;
+    alpha_count64 _C;
+    simd_level _simd_level = detect_simd_level(); // instruction set of the symbol counting kernel
+    count_codes_fn _count_codes = count_codes_kernel(_simd_level);
+  };
+
+
+
+  ////////////////////////////////////////////////
+  //
+  // packed_dna_index class implementation
+  //
+  ////////////////////////////////////////////////
+
+  inline packed_dna_index::packed_dna_index(rle_string bwt, unsigned num_threads): _bwt(std::move(bwt)) {
+    const uint64_t n = _bwt.size();
+    block_t empty;
+    std::memset(&empty,0,sizeof(empty));
+    _blocks.assign((n + block_size - 1) / block_size,empty);
+
+    // pack the symbols
+    uint64_t pos = 0;
+    for(const auto run:_bwt.runs()) {
+      if (run.value()>4) throw std::runtime_error("packed_dna_index: the bwt string is not a DNA string");
+      for(uint64_t end = pos + run.length();pos<end;++pos) {
+        block_t& blk = _blocks[pos / block_size];
+        const uint64_t r = pos % block_size;
+        if (run.value()==0) {
+          _dollars.push_back(pos);
+          ++blk.num_dollars;
+        } else {
+          blk.symbols[r/32] |= uint64_t(run.value()-1) << (2*(r%32));
+        }
+      }
+    }
+
+    // count the symbols of each superblock, and the occurences before each block relatively to its superblock
+    const size_t num_superblocks = (_blocks.size() + (1<<superblock_shift) - 1) >> superblock_shift;
+    std::vector<alpha_count64> totals(num_superblocks);
+    parallel_for(num_superblocks,num_threads,[&](size_t s) {
+      alpha_count64 counts;
+      counts.fill(0);
+      const size_t last = std::min<size_t>(_blocks.size(),(s+1)<<superblock_shift);
+      for(size_t b=s<<superblock_shift;b<last;++b) {
+        block_t& blk = _blocks[b];
+        std::copy(counts.begin(),counts.end(),blk.counts.begin());
+        uint64_t codes[4] = {0,0,0,0};
+        _count_codes(blk.symbols,std::min<uint64_t>(block_size,n - b*block_size),codes);
+        counts[0] += blk.num_dollars;
+        counts[1] += codes[0] - blk.num_dollars;
+        for(size_t c=2;c<5;++c) counts[c] += codes[c-1];
+      }
+      totals[s] = counts;
+    });
+
+    // prefix sum over the superblocks
+    _superblocks.resize(num_superblocks);
+    alpha_count64 counts;
+    counts.fill(0);
+    for(size_t s=0;s<num_superblocks;++s) {
+      _superblocks[s] = counts;
+      std::transform(counts.begin(),counts.end(),totals[s].begin(),counts.begin(),std::plus<uint64_t>());
+    }
+
+    // C[c] is the count of lexicography smaller symbols [0..c)
+    uint64_t s = 0;
+    for(size_t c=0;c<_C.size();++c) {
+      _C[c] = s;
+      s += counts[c];
+    }
+    assert(n==s);
+
+    // the runs of a mapped string are no longer needed in memory
+    _bwt.release();
+  }
+
+
+  inline void packed_dna_index::print_debug_info(std::ostream& os) const {
+    _bwt.print_debug_info(os);
+    os << "simd:" << simd_level_name(_simd_level) << std::endl;
+    os << "layout:packed" << std::endl;
+    os << "#blocks:" << _blocks.size() << " (" << (double) _blocks.size() * sizeof(block_t)/1024/1024 << "Mo)" << std::endl;
+    os << "#dollars:" << _dollars.size() << std::endl;
+    const uint64_t runs_bytes = _bwt.runs().size() * sizeof(run_t);
+    os << "runs:" << (double) runs_bytes/1024/1024 << "Mo" << (_bwt.mapped() ? " (mapped, released)" : " (in memory)") << std::endl;
+    const double n = std::max<uint64_t>(1,_bwt.size());
+    os << "bytes/symbol:" << (marks_bytes() + (_bwt.mapped() ? 0 : runs_bytes)) / n << std::endl;
+  }
+
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <algorithm>
+
+namespace bwt {
+
+
+	//! \return the default number of threads to use: the number of hardware threads
+	inline unsigned default_num_threads() {
+		return std::max(1u,std::thread::hardware_concurrency());
+	}
+
+
+	/*! \brief call f(i) for each i in [0,n) using up to num_threads threads
+	 *         Indices are distributed dynamically to the threads. The first exception thrown by f is
+	 *         rethrown in the calling thread once all threads are done.
+	 */
+	template<typename Function>
+	void parallel_for(size_t n, unsigned num_threads, Function f) {
+		num_threads = std::max(1u,std::min<unsigned>(num_threads,n));
+		if (num_threads==1) {
+			for(size_t i=0;i<n;++i) f(i);
+			return;
+		}
+
+		std::atomic<size_t> next(0);
+		std::exception_ptr error;
+		std::mutex error_mtx;
+		auto worker = [&]() {
+			try {
+				for(size_t i;(i = next++) < n;) f(i);
+			} catch(...) {
+				std::lock_guard<std::mutex> lck(error_mtx);
+				if (!error) error = std::current_exception();
+				next = n;
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for(unsigned t=1;t<num_threads;++t) threads.push_back(std::thread(worker));
+		worker();
+		for(auto& t:threads) t.join();
+		if (error) std::rethrow_exception(error);
+	}
+
+};
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef QMERTABLE_H
+#define QMERTABLE_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <cinttypes>
+
+#include "mapped_file.h"
+#include "parallel.h"
+#include "algo.h"
+
+namespace bwt {
+
+
+  /*! \struct qmer_table_header
+   *  \brief header of the files storing a serialized qmer_table (see qmer_table::save())
+   *         The header is followed by the intervals, starting on a 64 bytes boundary so that they can be used in place
+   *         from a memory mapping of the file.
+   */
+  struct qmer_table_header {
+    enum {magic = 0x51544D46, current_version = 1}; // "FMTQ"
+    uint32_t magic_number;
+    uint16_t version;
+    uint8_t q, sigma;
+    uint64_t bwt_size, num_runs;
+    uint64_t num_entries, entries_offset;
+  };
+
+  //! \return the default name of the q-mer table file associated to a bwt file
+  inline std::string qmer_table_filename(const std::string& bwt_filename) {return bwt_filename + ".qmt";}
+
+
+
+  /*! \class qmer_table
+   *  \brief intervals of all the strings of q symbols in the bwt, but the sentinel 0, so that backward searches
+   *         start from the interval of their last q symbols instead of extending q times the full range
+   *         The table has sigma^q entries, sigma being the alphabet size minus one: 16MB for DNA and q=10.
+   */
+  class qmer_table {
+  public:
+    //! \brief interval [lb,ub) of a q-mer, empty when lb>=ub
+    struct interval_t {uint64_t lb, ub;};
+
+    //! \brief build the table of the q-mers of the given index, with a depth-first search of the q first levels of its trie
+    //!        The subtrees of the strings of 2 symbols are searched in parallel by num_threads threads.
+    template<typename Index>
+    qmer_table(const Index& fm, unsigned q, unsigned num_threads = default_num_threads());
+
+    //! \brief load the table of the given index from a file previously written by save()
+    template<typename Index>
+    qmer_table(const Index& fm, const std::string& filename, bool populate = false, int advice = MADV_NORMAL);
+
+    //! \return the length of the strings of the table
+    unsigned q() const {return _q;}
+
+    //! \brief set range to the interval of the q symbols starting at first
+    //! \return false when one of the symbols is not in the table
+    template<typename Iterator>
+    inline bool lookup(Iterator first, std::pair<uint64_t,uint64_t>& range) const {
+      uint64_t idx = 0;
+      for(unsigned j=0;j<_q;++j,++first) {
+        const uint64_t c = *first;
+        if (c==0 || c>_sigma) return false;
+        idx = idx * _sigma + c - 1;
+      }
+      range = std::make_pair(_entries[idx].lb,_entries[idx].ub);
+      return true;
+    }
+
+    //! \return the memory used by the table, in bytes
+    size_t bytes() const {return _entries.size() * sizeof(interval_t);}
+
+    //! \brief serialize the table into the given file
+    void save(const std::string& filename) const;
+
+  private:
+    unsigned _q, _sigma;
+    uint64_t _bwt_size, _num_runs;
+    mapped_array<interval_t> _entries; // _entries[i] is the interval of the q-mer whose symbols minus one are the digits of i in base sigma
+  };
+
+
+  /*! \brief backward search of the string of symbols [first,last), the last q symbols being looked up in the table
+   *  \return the interval of the string, empty when it doesn't occur
+   */
+  template<typename Index, typename Iterator>
+  inline std::pair<uint64_t,uint64_t> backward_search(const Index& fm, const qmer_table& table, Iterator first, Iterator last) {
+    std::pair<uint64_t,uint64_t> range;
+    if ((size_t) (last - first) >= table.q() && table.lookup(last - table.q(),range)) return backward_search(fm,first,last - table.q(),range);
+    return backward_search(fm,first,last);
+  }
+
+
+
+  ////////////////////////////////////////////////
+  //
+  // qmer_table class implementation
+  //
+  ////////////////////////////////////////////////
+
+  template<typename Index>
+  qmer_table::qmer_table(const Index& fm, unsigned q, unsigned num_threads):
+    _q(q), _sigma(fm.alphabet_size() - 1), _bwt_size(fm.bwt().size()), _num_runs(fm.bwt().runs().size()) {
+    if (_q==0 || _q>16) throw std::invalid_argument("invalid q-mer length: must be in [1,16]");
+    std::vector<uint64_t> weights(_q+1,1); // weights[d] is the weight in the index of the symbol preceeding a suffix of length d
+    for(unsigned d=1;d<=_q;++d) weights[d] = weights[d-1] * _sigma;
+    typename mapped_array<interval_t>::vector_type entries(weights[_q],interval_t{0,0});
+
+    // the roots of the parallel searches are the suffixes of root_depth symbols
+    struct node_t {uint64_t lb, ub, idx; unsigned depth;};
+    const unsigned root_depth = std::min(2u,_q);
+    parallel_for(weights[root_depth],num_threads,[&](size_t r) {
+      std::vector<uint8_t> suffix(root_depth);
+      for(unsigned d=0;d<root_depth;++d) suffix[root_depth-1-d] = (r / weights[d]) % _sigma + 1;
+      const auto range = backward_search(fm,suffix.begin(),suffix.end());
+      std::vector<node_t> stack(1,node_t{range.first,range.second,r,root_depth});
+      typename Index::alpha_count64 low,high;
+      while (!stack.empty()) {
+        const node_t n = stack.back();
+        stack.pop_back();
+        if (n.lb>=n.ub) continue;
+        if (n.depth==_q) {
+          entries[n.idx] = interval_t{n.lb,n.ub};
+          continue;
+        }
+        extend_lhs(fm,low,high,n.lb,n.ub);
+        for(unsigned c=1;c<=_sigma;++c) stack.push_back(node_t{low[c],high[c],n.idx + (c-1) * weights[n.depth],n.depth+1});
+      }
+    });
+    _entries = mapped_array<interval_t>(std::move(entries));
+  }
+
+
+  template<typename Index>
+  qmer_table::qmer_table(const Index& fm, const std::string& filename, bool populate, int advice) {
+    auto map = std::make_shared<const mapped_file>(filename,populate,advice);
+    qmer_table_header h;
+    if (map->size() < sizeof(h)) throw std::runtime_error("q-mer table file is not properly formatted: truncated header");
+    std::memcpy(&h,map->data(),sizeof(h));
+    if (h.magic_number != qmer_table_header::magic) throw std::runtime_error("q-mer table file is not properly formatted: the magic number provided in file header doesn't correspond to the expected one");
+    if (h.version != qmer_table_header::current_version) throw std::runtime_error("q-mer table file version is not supported");
+    if (h.sigma != fm.alphabet_size() - 1) throw std::runtime_error("q-mer table file has been built with incompatible parameters");
+    if (h.bwt_size != fm.bwt().size() || h.num_runs != fm.bwt().runs().size()) throw std::runtime_error("q-mer table file doesn't correspond to the BWT string");
+    _q = h.q;
+    _sigma = h.sigma;
+    _bwt_size = h.bwt_size;
+    _num_runs = h.num_runs;
+    uint64_t n = 1;
+    for(unsigned d=0;d<_q;++d) n *= _sigma;
+    if (h.num_entries != n) throw std::runtime_error("q-mer table file is not properly formatted: wrong number of entries");
+    _entries = mapped_array<interval_t>(map,h.entries_offset,h.num_entries);
+  }
+
+
+  inline void qmer_table::save(const std::string& filename) const {
+    qmer_table_header h;
+    std::memset(&h,0,sizeof(h));
+    h.magic_number = qmer_table_header::magic;
+    h.version = qmer_table_header::current_version;
+    h.q = _q;
+    h.sigma = _sigma;
+    h.bwt_size = _bwt_size;
+    h.num_runs = _num_runs;
+    h.num_entries = _entries.size();
+    h.entries_offset = fm_index_header::align(sizeof(h));
+
+    std::ofstream os(filename,std::ios::binary);
+    if (!os) throw std::runtime_error("unable to create " + filename);
+    os.write(reinterpret_cast<const char*>(&h),sizeof(h));
+    while ((uint64_t) os.tellp() < h.entries_offset) os.put(0);
+    os.write(reinterpret_cast<const char*>(_entries.data()),_entries.size() * sizeof(interval_t));
+    if (!os) throw std::runtime_error("error while writing " + filename);
+  }
+
+};
+
+#endif
@@ -2,6 +2,15 @@
 #define RLESTRING_H
 
 #include <cinttypes>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <cstring>
+
+#include "mapped_file.h"
 
 namespace bwt {
 	
@@ -20,6 +29,23 @@ namespace bwt {
 	};
 
 
+	/*! \class run_span
+	 *  \brief read-only view over a contiguous array of runs
+	 */
+	struct run_span {
+		typedef const run_t* const_iterator;
+		run_span(const run_t* first,size_t n):_first(first),_n(n) {}
+		inline const_iterator begin() const {return _first;}
+		inline const_iterator end() const {return _first + _n;}
+		inline size_t size() const {return _n;}
+		inline bool empty() const {return _n==0;}
+		inline const run_t& operator[](size_t i) const {return _first[i];}
+	private:
+		const run_t* _first;
+		size_t _n;
+	};
+
+
 
 	/*! \class rle_string
 	 *  \brief run length encoded string
@@ -36,13 +62,26 @@ namespace bwt {
     inline uint64_t size() const {return _size;}
 
 		//! return the collection of rle runs
-		inline const std::vector<run_t>& runs() const {return _runs;}
+		inline run_span runs() const {
+			return _map ? run_span(reinterpret_cast<const run_t*>(_map->data()) + _map_offset,_map_runs) : run_span(_runs.data(),_runs.size());
+		}
+
+		//! \return true when the runs are a read-only view over a memory mapped file
+		inline bool mapped() const {return static_cast<bool>(_map);}
+
+		//! \brief drop the pages of a mapped string from the memory of the process, for an index that no longer reads
+		//!        its runs. Nothing is done for a string in memory.
+		void release() const {if (_map) _map->release();}
+
+    //! \return the average number of symbols per run
+    inline double avg_run_length() const {return runs().empty() ? 0 : (double) size() / runs().size();}
 
     //! \brief empty the string
-    void clear() {_runs.clear();_size = 0;}
+    void clear() {_runs.clear();_map.reset();_size = 0;}
     
     //! \brief append a character at the end of the string
     void push_back(uint8_t v) {
+      if (_map) throw std::logic_error("rle_string: cannot append to a memory mapped string");
       if (_runs.empty()) {
 				_runs.push_back(v);
       } else if (!_runs.back().full() && _runs.back().value()==v) {
@@ -53,32 +92,46 @@ namespace bwt {
       ++_size;
     }
 
+    //! \brief append n copies of a character at the end of the string, a run at a time
+    void append(uint8_t v, uint64_t n) {
+      if (_map) throw std::logic_error("rle_string: cannot append to a memory mapped string");
+      _size += n;
+      if (n && !_runs.empty() && !_runs.back().full() && _runs.back().value()==v) {
+        const uint8_t k = std::min<uint64_t>(n,31 - _runs.back().length());
+        _runs.back()._data += k;
+        n -= k;
+      }
+      for(;n;) {
+        const uint8_t k = std::min<uint64_t>(n,31);
+        _runs.push_back(v);
+        _runs.back()._data += k - 1;
+        n -= k;
+      }
+    }
+
 	  void print_debug_info(std::ostream& os) const {
 	    os << "size:" << size() << std::endl;
-	    os << "#run:" << _runs.size() << std::endl;
-	    os << "#full run:" << std::count_if(_runs.begin(),_runs.end(),[](const run_t& r){return r.full();}) << std::endl;
-	    os << "avg run size:" << (double) size() / _runs.size() << std::endl;
+	    const auto r = runs();
+	    os << "#run:" << r.size() << std::endl;
+	    os << "#full run:" << std::count_if(r.begin(),r.end(),[](const run_t& r){return r.full();}) << std::endl;
+	    os << "avg run size:" << avg_run_length() << std::endl;
+	    if (mapped()) os << "mapped:" << _map->size() << " bytes" << std::endl;
 	  }
 
   private:
+  	uint64_t _size = 0;
   	std::vector<run_t> _runs;
   	std::vector<uint16_t> _idx16;
   	std::vector<size_t> _idx;
+  	mapped_file_ptr _map;   // when not null, runs are read from the mapping instead of _runs
+  	size_t _map_offset = 0; // offset of the first run in the mapping
+  	size_t _map_runs = 0;   // number of runs in the mapping
   	
     //! \brief read rle encoded runs from an input stream
-    friend rle_string read_rle_bwt(const std::string& filename);
+    friend inline rle_string read_rle_bwt(const std::string& filename);
+    //! \brief map rle encoded runs from a file
+    friend inline rle_string map_rle_bwt(const std::string& filename, bool populate, int advice);
 	};
-	
-	
-	template<typename T> struct rle_iterator {
-		size_t length() const {return 1;}
-		T opertor*() const {return ;}
-		rle_iterator& operator++() {return *this;}
-	};
-
-
-	template<> void make_rle_iterator(bwt,size_t i) {
-	}
 
 
 	
@@ -93,29 +146,168 @@ namespace bwt {
     for(;first != last;first++) push_back(*first);
   }
 	
-  rle_string read_rle_bwt(const std::string& filename) {
-  	std::ifstream is(filename,std::ios::binary);
-  	
-    enum {BWF_NOFMI = 0,BWF_HASFMI} flag;
+  //! \brief header of the SGA run-length encoded BWT files
+  struct rle_bwt_header {
+    enum flag_t {BWF_NOFMI = 0,BWF_HASFMI};
     uint16_t magic_number;
     size_t num_strings, num_symbols, num_runs;
-    is.read(reinterpret_cast<char*>(&magic_number), sizeof(magic_number));
-    if (magic_number != 0xCACA) throw std::runtime_error("BWT file is not properly formatted: the magic number provided in file header doesn't correspond to the expected one");
-    is.read(reinterpret_cast<char*>(&num_strings), sizeof(num_strings));
-    is.read(reinterpret_cast<char*>(&num_symbols), sizeof(num_symbols));
-    is.read(reinterpret_cast<char*>(&num_runs), sizeof(num_runs));
-    is.read(reinterpret_cast<char*>(&flag), sizeof(flag));
-    std::cerr << "#symbols:" << num_symbols << std::endl;
-    std::cerr << "#strings:" << num_strings << std::endl;
-    std::cerr << "#run:" << num_runs << std::endl;
+    flag_t flag;
+    //! \brief size of the header on disk, the runs start right after it
+    static const size_t disk_size = sizeof(magic_number) + 3*sizeof(size_t) + sizeof(flag_t);
+  };
+
+  //! \brief parse the header of a SGA BWT file from a raw buffer of at least rle_bwt_header::disk_size bytes
+  inline rle_bwt_header parse_rle_bwt_header(const char* p) {
+    rle_bwt_header h;
+    std::memcpy(&h.magic_number,p,sizeof(h.magic_number)); p += sizeof(h.magic_number);
+    std::memcpy(&h.num_strings,p,sizeof(h.num_strings)); p += sizeof(h.num_strings);
+    std::memcpy(&h.num_symbols,p,sizeof(h.num_symbols)); p += sizeof(h.num_symbols);
+    std::memcpy(&h.num_runs,p,sizeof(h.num_runs)); p += sizeof(h.num_runs);
+    std::memcpy(&h.flag,p,sizeof(h.flag));
+    if (h.magic_number != 0xCACA) throw std::runtime_error("BWT file is not properly formatted: the magic number provided in file header doesn't correspond to the expected one");
+    std::cerr << "#symbols:" << h.num_symbols << std::endl;
+    std::cerr << "#strings:" << h.num_strings << std::endl;
+    std::cerr << "#run:" << h.num_runs << std::endl;
+    return h;
+  }
+	
+  inline rle_string read_rle_bwt(const std::string& filename) {
+  	std::ifstream is(filename,std::ios::binary);
+  	if (!is) throw std::runtime_error("unable to open " + filename);
+  	
+    char buf[rle_bwt_header::disk_size];
+    is.read(buf,sizeof(buf));
+    if (!is) throw std::runtime_error("BWT file is not properly formatted: truncated header");
+    rle_bwt_header h = parse_rle_bwt_header(buf);
     
     rle_string bwt;
-    bwt._runs.resize(num_runs);
-    is.read(reinterpret_cast<char*>(&bwt._runs[0]), num_runs*sizeof(bwt._runs[0]));
-    bwt._size = num_symbols;
+    bwt._runs.resize(h.num_runs);
+    is.read(reinterpret_cast<char*>(bwt._runs.data()), h.num_runs*sizeof(bwt._runs[0]));
+    if (!is) throw std::runtime_error("BWT file is not properly formatted: truncated run array");
+    bwt._size = h.num_symbols;
     
     return bwt;
   }
+
+  /*! \brief load a SGA BWT file as a read-only view over a memory mapping of the file
+   *         No copy of the runs is made: the pages are shared with the system page cache,
+   *         and thus with the other processes mapping the same file.
+   *  \param populate  prefault the whole file at mapping time (MAP_POPULATE)
+   *  \param advice    madvise() hint given for the mapping (e.g. MADV_RANDOM, MADV_WILLNEED)
+   */
+  inline rle_string map_rle_bwt(const std::string& filename, bool populate = false, int advice = MADV_NORMAL) {
+    auto map = std::make_shared<const mapped_file>(filename,populate,advice);
+    if (map->size() < rle_bwt_header::disk_size) throw std::runtime_error("BWT file is not properly formatted: truncated header");
+    rle_bwt_header h = parse_rle_bwt_header(reinterpret_cast<const char*>(map->data()));
+    if (map->size() < rle_bwt_header::disk_size + h.num_runs*sizeof(run_t)) throw std::runtime_error("BWT file is not properly formatted: truncated run array");
+    
+    rle_string bwt;
+    bwt._map = map;
+    bwt._map_offset = rle_bwt_header::disk_size;
+    bwt._map_runs = h.num_runs;
+    bwt._size = h.num_symbols;
+    
+    return bwt;
+  }
+  
+  //! \brief serialize the header of a SGA BWT file into a buffer of rle_bwt_header::disk_size bytes
+  inline void format_rle_bwt_header(const rle_bwt_header& h, char* p) {
+    std::memcpy(p,&h.magic_number,sizeof(h.magic_number)); p += sizeof(h.magic_number);
+    std::memcpy(p,&h.num_strings,sizeof(h.num_strings)); p += sizeof(h.num_strings);
+    std::memcpy(p,&h.num_symbols,sizeof(h.num_symbols)); p += sizeof(h.num_symbols);
+    std::memcpy(p,&h.num_runs,sizeof(h.num_runs)); p += sizeof(h.num_runs);
+    std::memcpy(p,&h.flag,sizeof(h.flag));
+  }
+
+  /*! \brief write a bwt string to a SGA BWT file, that read_rle_bwt() and map_rle_bwt() load
+   *         The number of strings of the header is the number of sentinels (symbol 0) of the string.
+   */
+  inline void write_rle_bwt(const std::string& filename, const rle_string& bwt) {
+    rle_bwt_header h;
+    h.magic_number = 0xCACA;
+    h.num_strings = 0;
+    for(const auto& r:bwt.runs()) if (r.value()==0) h.num_strings += r.length();
+    h.num_symbols = bwt.size();
+    h.num_runs = bwt.runs().size();
+    h.flag = rle_bwt_header::BWF_NOFMI;
+    char buf[rle_bwt_header::disk_size];
+    format_rle_bwt_header(h,buf);
+    
+    std::ofstream os(filename,std::ios::binary);
+    if (!os) throw std::runtime_error("unable to create " + filename);
+    os.write(buf,sizeof(buf));
+    os.write(reinterpret_cast<const char*>(bwt.runs().begin()),h.num_runs*sizeof(run_t));
+    if (!os) throw std::runtime_error("error while writing " + filename);
+  }
+  
+  
+  
+  /*! \class rle_bwt_writer
+   *  \brief sequential writer of a SGA BWT file, the symbols being run-length encoded as they are appended, so that
+   *         bwt strings larger than the memory can be written
+   */
+  class rle_bwt_writer {
+  public:
+    //! \brief create the file, the header being written by close()
+    rle_bwt_writer(const std::string& filename): _filename(filename), _os(filename,std::ios::binary) {
+      if (!_os) throw std::runtime_error("unable to create " + filename);
+      _os.seekp(rle_bwt_header::disk_size);
+      _runs.reserve(buffer_size);
+    }
+    
+    //! \brief append a symbol at the end of the string
+    inline void push_back(uint8_t v) {
+      if (_num_symbols && !_last.full() && _last.value()==v) {
+        ++_last;
+      } else {
+        if (_num_symbols) append(_last);
+        _last = run_t(v);
+      }
+      ++_num_symbols;
+      if (v==0) ++_num_strings;
+    }
+    
+    //! \return total number of symbols appended
+    inline uint64_t size() const {return _num_symbols;}
+    
+    //! \brief write the remaining runs and the header
+    void close() {
+      if (_num_symbols) append(_last);
+      flush();
+      rle_bwt_header h;
+      h.magic_number = 0xCACA;
+      h.num_strings = _num_strings;
+      h.num_symbols = _num_symbols;
+      h.num_runs = _num_runs;
+      h.flag = rle_bwt_header::BWF_NOFMI;
+      char buf[rle_bwt_header::disk_size];
+      format_rle_bwt_header(h,buf);
+      _os.seekp(0);
+      _os.write(buf,sizeof(buf));
+      _os.close();
+      if (!_os) throw std::runtime_error("error while writing " + _filename);
+    }
+    
+  private:
+    enum {buffer_size = 1<<20};
+    
+    inline void append(run_t r) {
+      _runs.push_back(r);
+      ++_num_runs;
+      if (_runs.size()==buffer_size) flush();
+    }
+    
+    void flush() {
+      _os.write(reinterpret_cast<const char*>(_runs.data()),_runs.size()*sizeof(run_t));
+      _runs.clear();
+    }
+    
+    std::string _filename;
+    std::ofstream _os;
+    run_t _last;
+    uint64_t _num_symbols = 0, _num_strings = 0, _num_runs = 0;
+    std::vector<run_t> _runs;
+  };
   
 };
 
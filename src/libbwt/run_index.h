@@ -0,0 +1,238 @@
+#ifndef RUNINDEX_H
+#define RUNINDEX_H
+
+
+#include <algorithm>
+#include <vector>
+#include <array>
+#include <iostream>
+#include <stdexcept>
+#include <cinttypes>
+
+#include "rle.h"
+#include "simd.h"
+
+namespace bwt {
+
+
+  /*! \class run_dna_index
+   *  \brief occurence index of a DNA bwt string (alphabet $ACGT) whose size is proportional to the number r of maximal
+   *         runs of the bwt, as in the r-index (Gagie, Navarro and Prezza, 2018), instead of the number of symbols
+   *         The bwt is kept as the heads of its maximal runs, the runs of 31 symbols of the rle_string being merged. The
+   *         positions are split into buckets holding a few tens of runs on average, each bucket storing the occurences
+   *         before it and the index of its first run, a run crossing the start of a bucket being split there. A run
+   *         takes 3 bytes: its symbol and its offset in its bucket. occ(i) adds the lengths of the runs of the bucket
+   *         of i starting before i, read from one or two cache lines.
+   *         The runs of the rle_string are no longer read once the index is built: when the string is mapped from a
+   *         file, its pages are dropped from the memory of the process, so that highly repetitive collections are
+   *         indexed with a small fraction of the memory of the other backends.
+   */
+  class run_dna_index {
+  public:
+    //
+    // public types definitions
+    //
+    //! \brief define an array of numbers for each alphabet character
+    typedef std::array<uint64_t,5> alpha_count64;
+
+    //
+    // constructors
+    //
+    //! \brief build the index of the given bwt string, in a single pass over its runs. The string is moved into the
+    //!        index, that owns it.
+    run_dna_index(rle_string bwt);
+
+    //
+    // methods
+    //
+    //! \return size of the alphabet
+    size_t alphabet_size() const {return 5;}
+
+    //! \return number of occurence of symbol c in bwt[0..i]
+    inline alpha_count64 occ(const uint64_t i) const {
+      uint8_t c;
+      return occ(i,c);
+    }
+
+    //! \return occ(.,i) and occ(.,j) with i<=j
+    inline std::pair<alpha_count64,alpha_count64> occ_pair(const uint64_t i, const uint64_t j) const {return std::make_pair(occ(i),occ(j));}
+
+    //! \brief the rle_string indexed by the object and storing the BWT, whose runs are not read by the index
+    const rle_string& bwt() const {return _bwt;}
+
+    //! \brief number of occurence of symbols [0..c) in bwt string.
+    const alpha_count64& C() const {return _C;}
+
+    //! \return last to first mapping at position i for all characters of the alphabet
+    inline alpha_count64 lf(const uint64_t i) const {
+      auto n(occ(i));
+      std::transform(n.begin(),n.end(),C().begin(),n.begin(),std::plus<uint64_t>());
+      return n;
+    }
+
+    //! \return bwt[i], the ith character of bwt string
+    inline uint8_t operator[](const uint64_t i) const {
+      uint8_t c;
+      occ(i,c);
+      return c;
+    }
+
+    //! \return the symbol c=bwt[i] and the row lf(i)[c]-1 of the suffix preceding the one of row i, with a single rank
+    inline std::pair<uint8_t,uint64_t> lf_step(const uint64_t i) const {
+      uint8_t c;
+      const alpha_count64 n = occ(i,c);
+      return std::make_pair(c,_C[c] + n[c] - 1);
+    }
+
+    //! \brief prefetch the bucket read by occ(i), so that the memory accesses of independent ranks overlap
+    inline void prefetch_marks(const uint64_t i) const {__builtin_prefetch(&_buckets[i >> _shift]);}
+
+    //! \brief prefetch the runs of the bucket read by occ(i), once the bucket is in cache
+    inline void prefetch_runs(const uint64_t i) const {
+      const uint64_t k = first_run(i >> _shift);
+      __builtin_prefetch(&_offsets[k]);
+      __builtin_prefetch(&_symbols[k]);
+    }
+
+    //! \return number of maximal runs of the bwt string
+    uint64_t num_runs() const {return _num_runs;}
+
+    //! \brief output debugging informations to the given stream
+    void print_debug_info(std::ostream& os) const;
+
+    //! \return the memory used by the runs and the buckets, in bytes
+    size_t marks_bytes() const {
+      return _offsets.size() * sizeof(uint16_t) + _symbols.size() + _buckets.size() * sizeof(bucket_t) + _superblocks.size() * sizeof(superblock_t);
+    }
+
+    //! \brief nothing to do: the runs of a bucket are scanned without simd instructions
+    void set_simd_level(simd_level) {}
+
+  private:
+    //
+    // internal types
+    //
+    enum {runs_per_bucket = 24, max_shift = 16, superblock_shift = 32};
+    // occurences before the bucket and index of its first run, relative to the superblock
+    struct bucket_t {uint32_t counts[5], first;};
+    struct superblock_t {alpha_count64 counts; uint64_t first;};
+
+    //! \return index of the first run of bucket b
+    inline uint64_t first_run(const uint64_t b) const {return _superblocks[b >> (superblock_shift - _shift)].first + _buckets[b].first;}
+
+    //! \return occ(i), and set c to bwt[i]
+    inline alpha_count64 occ(const uint64_t i, uint8_t& c) const {
+      const uint64_t b = i >> _shift;
+      const bucket_t& bkt = _buckets[b];
+      const superblock_t& sb = _superblocks[b >> (superblock_shift - _shift)];
+      alpha_count64 n;
+      for(size_t x=0;x<5;++x) n[x] = sb.counts[x] + bkt.counts[x];
+      // add the runs of the bucket up to the one of i, the bucket after the last one holding no run
+      const uint16_t r = i - (b << _shift);
+      uint64_t k = sb.first + bkt.first;
+      const uint64_t last = first_run(b+1);
+      for(;k+1<last && _offsets[k+1]<=r;++k) n[_symbols[k]] += _offsets[k+1] - _offsets[k];
+      c = _symbols[k];
+      n[c] += r - _offsets[k] + 1;
+      return n;
+    }
+
+    //
+    // internal attributes
+    //
+    std::vector<uint16_t> _offsets;          // offset of each run in its bucket
+    std::vector<uint8_t> _symbols;           // symbol of each run
+    std::vector<bucket_t> _buckets;
+    std::vector<superblock_t> _superblocks;  // occurences before each superblock of 2^32 positions, and its first run
+    unsigned _shift;                         // a bucket spans 2^_shift positions
+    uint64_t _num_runs;
+    rle_string _bwt;
+    alpha_count64 _C;
+  };
+
+
+
+  ////////////////////////////////////////////////
+  //
+  // run_dna_index class implementation
+  //
+  ////////////////////////////////////////////////
+
+  inline run_dna_index::run_dna_index(rle_string bwt): _num_runs(0), _bwt(std::move(bwt)) {
+    const uint64_t n = _bwt.size();
+
+    // count the maximal runs to size the buckets
+    uint8_t last = 0;
+    for(const auto run:_bwt.runs()) {
+      if (run.value()>4) throw std::runtime_error("run_dna_index: the bwt string is not a DNA string");
+      if (_num_runs==0 || run.value()!=last) ++_num_runs;
+      last = run.value();
+    }
+    _shift = 6;
+    while (_shift < max_shift && (uint64_t(1) << _shift) * _num_runs < runs_per_bucket * n) ++_shift;
+    const uint64_t num_buckets = (n >> _shift) + 2;
+    _buckets.resize(num_buckets);
+    _superblocks.resize(((num_buckets - 1) >> (superblock_shift - _shift)) + 1);
+
+    // store the maximal runs, split at the start of each bucket
+    alpha_count64 counts;
+    counts.fill(0);
+    uint64_t pos = 0, b = 0;
+    auto open_bucket = [&]() {
+      const uint64_t s = b >> (superblock_shift - _shift);
+      if ((b << _shift) % (uint64_t(1) << superblock_shift) == 0) _superblocks[s] = superblock_t{counts,_offsets.size()};
+      bucket_t& bkt = _buckets[b];
+      for(size_t x=0;x<5;++x) bkt.counts[x] = counts[x] - _superblocks[s].counts[x];
+      bkt.first = _offsets.size() - _superblocks[s].first;
+    };
+    open_bucket();
+    last = 5;
+    for(const auto run:_bwt.runs()) {
+      for(uint64_t end = pos + run.length(); pos < end;) {
+        if (pos == (b+1) << _shift) {
+          ++b;
+          open_bucket();
+          last = 5;
+        }
+        if (run.value()!=last) {
+          _offsets.push_back(pos - (b << _shift));
+          _symbols.push_back(run.value());
+          last = run.value();
+        }
+        // symbols of the run in this bucket
+        const uint64_t k = std::min(end,(b+1) << _shift) - pos;
+        counts[run.value()] += k;
+        pos += k;
+      }
+    }
+    if (pos != n) throw std::runtime_error("run_dna_index: the runs don't match the size of the bwt string");
+    for(++b;b<num_buckets;++b) open_bucket();
+    _offsets.shrink_to_fit();
+    _symbols.shrink_to_fit();
+
+    // C[c] is the count of lexicography smaller symbols [0..c)
+    uint64_t s = 0;
+    for(size_t c=0;c<_C.size();++c) {
+      _C[c] = s;
+      s += counts[c];
+    }
+
+    // the runs of a mapped string are no longer needed in memory
+    _bwt.release();
+  }
+
+
+  inline void run_dna_index::print_debug_info(std::ostream& os) const {
+    os << "size:" << _bwt.size() << std::endl;
+    os << "layout:runs" << std::endl;
+    os << "#maximal runs:" << _num_runs << " (" << _offsets.size() << " with the splits at the buckets)" << std::endl;
+    os << "avg run size:" << (double) _bwt.size() / std::max<uint64_t>(1,_num_runs) << std::endl;
+    os << "bucket size:" << (uint64_t(1) << _shift) << std::endl;
+    os << "index:" << marks_bytes() / 1024.0 / 1024.0 << "Mo" << std::endl;
+    const double n = std::max<uint64_t>(1,_bwt.size());
+    os << "bytes/symbol:" << marks_bytes() / n << std::endl;
+  }
+
+};
+
+#endif
@@ -0,0 +1,201 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cinttypes>
+#include <cstddef>
+
+#include "rle.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define BWT_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace bwt {
+
+
+	//! \brief instruction sets available to the run decoding kernels
+	enum simd_level {SIMD_SCALAR = 0, SIMD_SSE42, SIMD_AVX2};
+
+	//! \return the best instruction set supported by the running cpu
+	inline simd_level detect_simd_level() {
+#ifdef BWT_X86_SIMD
+		if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+		if (__builtin_cpu_supports("sse4.2")) return SIMD_SSE42;
+#endif
+		return SIMD_SCALAR;
+	}
+
+	//! \return printable name of an instruction set
+	inline const char* simd_level_name(simd_level level) {
+		switch(level) {
+			case SIMD_AVX2: return "avx2";
+			case SIMD_SSE42: return "sse4.2";
+			default: return "scalar";
+		}
+	}
+
+
+	/*! \brief kernel skipping the leading runs of [run,run+n) as long as their cumulated length doesn't exceed max_length
+	 *         The lengths of the skipped runs are added to counts[value] and to length.
+	 *  \return the number of skipped runs
+	 */
+	typedef size_t (*skip_runs_fn)(const run_t* run, size_t n, uint64_t max_length, uint64_t* counts, uint64_t& length);
+
+
+	//! \brief reference implementation of skip_runs_fn, run by run
+	template<size_t AlphabetSize>
+	size_t skip_runs_scalar(const run_t* run, size_t n, uint64_t max_length, uint64_t* counts, uint64_t& length) {
+		uint64_t total = 0;
+		size_t i = 0;
+		for(;i<n;++i) {
+			const auto len = run[i].length();
+			if (total + len > max_length) break;
+			total += len;
+			counts[run[i].value()] += len;
+		}
+		length += total;
+		return i;
+	}
+
+
+#ifdef BWT_X86_SIMD
+	/*! \brief SSE4.2 implementation of skip_runs_fn
+	 *         Runs are decoded 16 at a time: the 5-bit lengths are summed with psadbw, per symbol after masking
+	 *         the lengths with a comparison of the 3-bit values. Blocks that don't fit are left to the caller.
+	 */
+	template<size_t AlphabetSize>
+	__attribute__((target("sse4.2")))
+	size_t skip_runs_sse42(const run_t* run, size_t n, uint64_t max_length, uint64_t* counts, uint64_t& length) {
+		const uint8_t* p = reinterpret_cast<const uint8_t*>(run);
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i len_mask = _mm_set1_epi8(0x1F);
+		const __m128i val_mask = _mm_set1_epi8(0x07);
+		__m128i acc[AlphabetSize];
+		for(auto& a:acc) a = zero;
+
+		uint64_t total = 0;
+		size_t i = 0;
+		for(;i+16<=n;i+=16) {
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p+i));
+			const __m128i len = _mm_and_si128(v,len_mask);
+			const __m128i sad = _mm_sad_epu8(len,zero);
+			const uint64_t block = _mm_extract_epi64(sad,0) + _mm_extract_epi64(sad,1);
+			if (total + block > max_length) break;
+			total += block;
+			const __m128i val = _mm_and_si128(_mm_srli_epi16(v,5),val_mask);
+			for(size_t c=0;c<AlphabetSize;++c) {
+				const __m128i m = _mm_cmpeq_epi8(val,_mm_set1_epi8(c));
+				acc[c] = _mm_add_epi64(acc[c],_mm_sad_epu8(_mm_and_si128(len,m),zero));
+			}
+		}
+		for(size_t c=0;c<AlphabetSize;++c) counts[c] += _mm_extract_epi64(acc[c],0) + _mm_extract_epi64(acc[c],1);
+		length += total;
+		return i;
+	}
+
+	//! \return the sum of the 4 64-bit integers of x
+	__attribute__((target("avx2")))
+	inline uint64_t hsum_epi64(__m256i x) {
+		const __m128i s = _mm_add_epi64(_mm256_castsi256_si128(x),_mm256_extracti128_si256(x,1));
+		return _mm_extract_epi64(s,0) + _mm_extract_epi64(s,1);
+	}
+
+	/*! \brief AVX2 implementation of skip_runs_fn, same as skip_runs_sse42() with 32 runs at a time
+	 */
+	template<size_t AlphabetSize>
+	__attribute__((target("avx2")))
+	size_t skip_runs_avx2(const run_t* run, size_t n, uint64_t max_length, uint64_t* counts, uint64_t& length) {
+		const uint8_t* p = reinterpret_cast<const uint8_t*>(run);
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i len_mask = _mm256_set1_epi8(0x1F);
+		const __m256i val_mask = _mm256_set1_epi8(0x07);
+		__m256i acc[AlphabetSize];
+		for(auto& a:acc) a = zero;
+
+		uint64_t total = 0;
+		size_t i = 0;
+		for(;i+32<=n;i+=32) {
+			const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p+i));
+			const __m256i len = _mm256_and_si256(v,len_mask);
+			const uint64_t block = hsum_epi64(_mm256_sad_epu8(len,zero));
+			if (total + block > max_length) break;
+			total += block;
+			const __m256i val = _mm256_and_si256(_mm256_srli_epi16(v,5),val_mask);
+			for(size_t c=0;c<AlphabetSize;++c) {
+				const __m256i m = _mm256_cmpeq_epi8(val,_mm256_set1_epi8(c));
+				acc[c] = _mm256_add_epi64(acc[c],_mm256_sad_epu8(_mm256_and_si256(len,m),zero));
+			}
+		}
+		for(size_t c=0;c<AlphabetSize;++c) counts[c] += hsum_epi64(acc[c]);
+		length += total;
+
+		// finish with 16 runs blocks
+		return i + skip_runs_sse42<AlphabetSize>(run+i,n-i,max_length-total,counts,length);
+	}
+#endif
+
+
+	/*! \brief kernel counting the 2-bit codes of the first m symbols packed 32 per word, the first symbol in the lowest bits
+	 *         The number of symbols of code c is added to counts[c].
+	 */
+	typedef void (*count_codes_fn)(const uint64_t* words, size_t m, uint64_t* counts);
+
+
+	//! \brief body of the count_codes_fn kernels: code 1, 2 and 3 are counted with popcounts of the low bits, the high bits, and both
+	inline void count_codes_body(const uint64_t* words, size_t m, uint64_t* counts) {
+		const uint64_t lo_mask = 0x5555555555555555ULL;
+		uint64_t lo = 0, hi = 0, both = 0;
+		size_t w = 0;
+		for(;(w+1)*32<=m;++w) {
+			const uint64_t l = words[w] & lo_mask, h = (words[w]>>1) & lo_mask;
+			lo += __builtin_popcountll(l);
+			hi += __builtin_popcountll(h);
+			both += __builtin_popcountll(l & h);
+		}
+		if (m % 32) {
+			const uint64_t x = words[w] & ((uint64_t(1)<<(2*(m%32))) - 1);
+			const uint64_t l = x & lo_mask, h = (x>>1) & lo_mask;
+			lo += __builtin_popcountll(l);
+			hi += __builtin_popcountll(h);
+			both += __builtin_popcountll(l & h);
+		}
+		counts[0] += m - lo - hi + both;
+		counts[1] += lo - both;
+		counts[2] += hi - both;
+		counts[3] += both;
+	}
+
+	//! \brief reference implementation of count_codes_fn
+	inline void count_codes_scalar(const uint64_t* words, size_t m, uint64_t* counts) {count_codes_body(words,m,counts);}
+
+#ifdef BWT_X86_SIMD
+	//! \brief count_codes_fn using the popcnt instruction, that comes with SSE4.2
+	__attribute__((target("popcnt")))
+	inline void count_codes_popcnt(const uint64_t* words, size_t m, uint64_t* counts) {count_codes_body(words,m,counts);}
+#endif
+
+
+	//! \return the code counting kernel for the given instruction set
+	inline count_codes_fn count_codes_kernel(simd_level level) {
+#ifdef BWT_X86_SIMD
+		if (level>=SIMD_SSE42) return count_codes_popcnt;
+#endif
+		return count_codes_scalar;
+	}
+
+
+	//! \return the run decoding kernel for the given instruction set
+	template<size_t AlphabetSize>
+	inline skip_runs_fn skip_runs_kernel(simd_level level) {
+		static_assert(AlphabetSize<=8,"run values are 3-bit wide");
+#ifdef BWT_X86_SIMD
+		if (level>=SIMD_AVX2) return skip_runs_avx2<AlphabetSize>;
+		if (level>=SIMD_SSE42) return skip_runs_sse42<AlphabetSize>;
+#endif
+		return skip_runs_scalar<AlphabetSize>;
+	}
+
+};
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef SUFFIXARRAY_H
+#define SUFFIXARRAY_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <cinttypes>
+
+#include "mapped_file.h"
+#include "parallel.h"
+#include "fm_index.h"
+
+namespace bwt {
+
+
+  /*! \struct sampled_suffix_array_header
+   *  \brief header of the files storing a serialized sampled_suffix_array (see sampled_suffix_array::save())
+   *         The header is followed by the bit vector, the ranks and the samples, each starting on a 64 bytes boundary
+   *         so that they can be used in place from a memory mapping of the file.
+   */
+  struct sampled_suffix_array_header {
+    enum {magic = 0x41534D46, current_version = 1}; // "FMSA"
+    uint32_t magic_number;
+    uint16_t version;
+    uint8_t offset_bits, reserved;
+    uint64_t rate;
+    uint64_t bwt_size, num_runs;
+    uint64_t num_words, num_ranks, num_samples;
+    uint64_t words_offset, ranks_offset, samples_offset;
+  };
+
+  //! \return the default name of the suffix array samples file associated to a bwt file
+  inline std::string sampled_suffix_array_filename(const std::string& bwt_filename) {return bwt_filename + ".ssa";}
+
+
+
+  /*! \class sampled_suffix_array
+   *  \brief positions in the strings of the collection of one bwt row every rate symbols of each string, so that locate()
+   *         finds the position of any row with less than rate LF steps
+   *         A row is sampled when the offset of its suffix in its string is a multiple of the rate. The sampled rows are
+   *         marked in a bit vector, whose rank gives the index of their sample. The collection follows the SGA
+   *         convention: row s is the suffix "$" of string s, and a string is read backward by LF steps from it.
+   */
+  class sampled_suffix_array {
+  public:
+    //! \brief position of a suffix: index of its string in the collection and offset in the string
+    struct position_t {
+      uint64_t string, offset;
+      bool operator==(const position_t& p) const {return string==p.string && offset==p.offset;}
+    };
+
+    //! \brief build the samples of the given index by walking all its strings, the walks being distributed
+    //!        to num_threads threads
+    template<typename Index>
+    sampled_suffix_array(const Index& fm, unsigned rate = 32, unsigned num_threads = default_num_threads());
+
+    //! \brief load the samples of the given index from a file previously written by save()
+    template<typename Index>
+    sampled_suffix_array(const Index& fm, const std::string& filename, bool populate = false, int advice = MADV_NORMAL);
+
+    //! \return the number of symbols of the strings between two samples
+    unsigned rate() const {return _rate;}
+
+    //! \return true when row i is sampled
+    inline bool sampled(const uint64_t i) const {return (_words[i/64] >> (i%64)) & 1;}
+
+    //! \return the position of the suffix of row i in the collection, with at most rate-1 LF steps
+    template<typename Index>
+    inline position_t locate(const Index& fm, uint64_t i) const {
+      uint64_t steps = 0;
+      for(;!sampled(i);++steps) i = fm.lf_step(i).second;
+      const uint64_t v = _samples[rank(i)];
+      return position_t{v >> _offset_bits,(v & ((uint64_t(1)<<_offset_bits) - 1)) + steps};
+    }
+
+    //! \return the memory used by the samples, in bytes
+    size_t bytes() const {return (_words.size() + _ranks.size() + _samples.size()) * sizeof(uint64_t);}
+
+    //! \brief serialize the samples into the given file
+    void save(const std::string& filename) const;
+
+  private:
+    enum {words_per_rank = 8};
+
+    //! \return number of sampled rows before row i
+    inline uint64_t rank(const uint64_t i) const {
+      const uint64_t w = i/64;
+      uint64_t r = _ranks[w/words_per_rank];
+      for(uint64_t j=w/words_per_rank*words_per_rank;j<w;++j) r += __builtin_popcountll(_words[j]);
+      return r + __builtin_popcountll(_words[w] & ((uint64_t(1)<<(i%64)) - 1));
+    }
+
+    unsigned _rate, _offset_bits;
+    uint64_t _bwt_size, _num_runs;
+    mapped_array<uint64_t> _words;   // bit i is set when row i is sampled
+    mapped_array<uint64_t> _ranks;   // _ranks[b] is the number of bits set in the words_per_rank*b first words
+    mapped_array<uint64_t> _samples; // position of the sampled rows in their order: string << _offset_bits | offset
+  };
+
+
+
+  ////////////////////////////////////////////////
+  //
+  // sampled_suffix_array class implementation
+  //
+  ////////////////////////////////////////////////
+
+  template<typename Index>
+  sampled_suffix_array::sampled_suffix_array(const Index& fm, unsigned rate, unsigned num_threads):
+    _rate(rate), _bwt_size(fm.bwt().size()), _num_runs(fm.bwt().runs().size()) {
+    if (_rate==0) throw std::invalid_argument("invalid suffix array sampling rate: must be positive");
+    const uint64_t n = _bwt_size;
+    const uint64_t num_strings = fm.C()[1];
+
+    // walk the strings by chunks, each chunk keeping the samples of its strings
+    struct sample_t {uint64_t row, string, offset;};
+    const size_t num_chunks = std::min<uint64_t>(num_strings,64 * (uint64_t) num_threads);
+    std::vector< std::vector<sample_t> > chunks(num_chunks);
+    parallel_for(num_chunks,num_threads,[&](size_t k) {
+      std::vector<uint64_t> rows;
+      for(uint64_t s = num_strings * k / num_chunks; s < num_strings * (k+1) / num_chunks; ++s) {
+        // rows[j] is the suffix of string s at offset len-j, the walk ends on the whole string, preceeded by '$'
+        rows.clear();
+        for(uint64_t i = s;;) {
+          rows.push_back(i);
+          const auto step = fm.lf_step(i);
+          if (step.first==0) break;
+          if (rows.size() > n) throw std::runtime_error("sampled_suffix_array: the bwt string is not a collection of strings");
+          i = step.second;
+        }
+        const uint64_t len = rows.size() - 1;
+        for(uint64_t j = len % _rate; j <= len; j += _rate) chunks[k].push_back(sample_t{rows[j],s,len - j});
+      }
+    });
+
+    // mark the sampled rows
+    typename mapped_array<uint64_t>::vector_type words((n + 63) / 64,0);
+    uint64_t max_offset = 0;
+    for(const auto& chunk:chunks) {
+      for(const auto& x:chunk) {
+        words[x.row/64] |= uint64_t(1) << (x.row%64);
+        max_offset = std::max(max_offset,x.offset);
+      }
+    }
+    typename mapped_array<uint64_t>::vector_type ranks(words.size() / words_per_rank + 1);
+    uint64_t total = 0;
+    for(size_t w = 0; w <= words.size(); ++w) {
+      if (w % words_per_rank == 0) ranks[w / words_per_rank] = total;
+      if (w < words.size()) total += __builtin_popcountll(words[w]);
+    }
+    _words = mapped_array<uint64_t>(std::move(words));
+    _ranks = mapped_array<uint64_t>(std::move(ranks));
+
+    // store the samples in the order of their rows
+    _offset_bits = 1;
+    while (max_offset >> _offset_bits) ++_offset_bits;
+    if (_offset_bits < 64 && num_strings > (uint64_t(1) << (64 - _offset_bits))) throw std::runtime_error("sampled_suffix_array: too many strings to pack their positions");
+    typename mapped_array<uint64_t>::vector_type samples(total);
+    parallel_for(num_chunks,num_threads,[&](size_t k) {
+      for(const auto& x:chunks[k]) samples[rank(x.row)] = (x.string << _offset_bits) | x.offset;
+    });
+    _samples = mapped_array<uint64_t>(std::move(samples));
+  }
+
+
+  template<typename Index>
+  sampled_suffix_array::sampled_suffix_array(const Index& fm, const std::string& filename, bool populate, int advice) {
+    auto map = std::make_shared<const mapped_file>(filename,populate,advice);
+    sampled_suffix_array_header h;
+    if (map->size() < sizeof(h)) throw std::runtime_error("suffix array samples file is not properly formatted: truncated header");
+    std::memcpy(&h,map->data(),sizeof(h));
+    if (h.magic_number != sampled_suffix_array_header::magic) throw std::runtime_error("suffix array samples file is not properly formatted: the magic number provided in file header doesn't correspond to the expected one");
+    if (h.version != sampled_suffix_array_header::current_version) throw std::runtime_error("suffix array samples file version is not supported");
+    if (h.bwt_size != fm.bwt().size() || h.num_runs != fm.bwt().runs().size()) throw std::runtime_error("suffix array samples file doesn't correspond to the BWT string");
+    if (h.num_words != (h.bwt_size + 63) / 64 || h.num_ranks != h.num_words / words_per_rank + 1) throw std::runtime_error("suffix array samples file is not properly formatted: wrong number of entries");
+    _rate = h.rate;
+    _offset_bits = h.offset_bits;
+    _bwt_size = h.bwt_size;
+    _num_runs = h.num_runs;
+    _words = mapped_array<uint64_t>(map,h.words_offset,h.num_words);
+    _ranks = mapped_array<uint64_t>(map,h.ranks_offset,h.num_ranks);
+    _samples = mapped_array<uint64_t>(map,h.samples_offset,h.num_samples);
+  }
+
+
+  inline void sampled_suffix_array::save(const std::string& filename) const {
+    sampled_suffix_array_header h;
+    std::memset(&h,0,sizeof(h));
+    h.magic_number = sampled_suffix_array_header::magic;
+    h.version = sampled_suffix_array_header::current_version;
+    h.offset_bits = _offset_bits;
+    h.rate = _rate;
+    h.bwt_size = _bwt_size;
+    h.num_runs = _num_runs;
+    h.num_words = _words.size();
+    h.num_ranks = _ranks.size();
+    h.num_samples = _samples.size();
+    h.words_offset = fm_index_header::align(sizeof(h));
+    h.ranks_offset = fm_index_header::align(h.words_offset + h.num_words * sizeof(uint64_t));
+    h.samples_offset = fm_index_header::align(h.ranks_offset + h.num_ranks * sizeof(uint64_t));
+
+    std::ofstream os(filename,std::ios::binary);
+    if (!os) throw std::runtime_error("unable to create " + filename);
+    auto pad_to = [&](uint64_t offset) {while ((uint64_t) os.tellp() < offset) os.put(0);};
+    os.write(reinterpret_cast<const char*>(&h),sizeof(h));
+    pad_to(h.words_offset);
+    os.write(reinterpret_cast<const char*>(_words.data()),_words.size() * sizeof(uint64_t));
+    pad_to(h.ranks_offset);
+    os.write(reinterpret_cast<const char*>(_ranks.data()),_ranks.size() * sizeof(uint64_t));
+    pad_to(h.samples_offset);
+    os.write(reinterpret_cast<const char*>(_samples.data()),_samples.size() * sizeof(uint64_t));
+    if (!os) throw std::runtime_error("error while writing " + filename);
+  }
+
+};
+
+#endif
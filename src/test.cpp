@@ -2,8 +2,18 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
 #include <fm_index.h>
+#include <dna_index.h>
 #include <algo.h>
+#include <qmer_table.h>
+#include <kmer_table.h>
+#include <suffix_array.h>
+#include <bcr.h>
+#include <bcr_external.h>
+#include <merge.h>
 
 
 
@@ -56,8 +66,673 @@ void test_fm() {
 
 
 
+void test_rle_io() {
+	// write a small SGA formatted bwt file
+	const std::string alphabet("$ACGT");
+	std::string str("ACG$TTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTA$CA");
+	std::transform(str.begin(),str.end(),str.begin(),[&](char c){return alphabet.find(c);});
+	bwt::rle_string bwt(str.begin(),str.end());
+	
+	const std::string filename("test_rle_io.bwt");
+	{
+		std::ofstream os(filename,std::ios::binary);
+		uint16_t magic_number = 0xCACA;
+		size_t num_strings = 2, num_symbols = bwt.size(), num_runs = bwt.runs().size();
+		uint32_t flag = 0;
+		os.write(reinterpret_cast<const char*>(&magic_number),sizeof(magic_number));
+		os.write(reinterpret_cast<const char*>(&num_strings),sizeof(num_strings));
+		os.write(reinterpret_cast<const char*>(&num_symbols),sizeof(num_symbols));
+		os.write(reinterpret_cast<const char*>(&num_runs),sizeof(num_runs));
+		os.write(reinterpret_cast<const char*>(&flag),sizeof(flag));
+		os.write(reinterpret_cast<const char*>(bwt.runs().begin()),num_runs*sizeof(bwt::run_t));
+	}
+	
+	// read and map it back, both must give the same runs
+	bwt::rle_string r = bwt::read_rle_bwt(filename);
+	bwt::rle_string m = bwt::map_rle_bwt(filename,true,MADV_RANDOM);
+	assert(!r.mapped() && m.mapped());
+	assert(r.size()==bwt.size() && m.size()==bwt.size());
+	assert(r.runs().size()==bwt.runs().size() && m.runs().size()==bwt.runs().size());
+	for(size_t i=0;i<bwt.runs().size();++i) {
+		assert(r.runs()[i]._data==bwt.runs()[i]._data);
+		assert(m.runs()[i]._data==bwt.runs()[i]._data);
+	}
+	
+	// an index over the mapped string answers like the in-memory one
+	bwt::fm_index<5> fm(m);
+	for(size_t i=0;i<str.size();i++) assert(fm[i]==str[i]);
+	
+	// a saved index can be loaded back in place of the computed one
+	const std::string index_filename(bwt::fm_index_filename(filename));
+	fm.save(index_filename);
+	bwt::fm_index<5> fm2(r,index_filename);
+	assert(fm2.C()==fm.C());
+	for(size_t i=0;i<str.size();i++) assert(fm2.occ(i)==fm.occ(i));
+	
+	// it is rejected for another bwt string
+	bool rejected = false;
+	try {bwt::fm_index<5>(bwt::rle_string(str.begin(),str.begin()+10),index_filename);} catch(const std::runtime_error&) {rejected = true;}
+	assert(rejected);
+	
+	std::remove(index_filename.c_str());
+	std::remove(filename.c_str());
+}
+
+
+//! \brief random string over an alphabet of 5 symbols made of n stretches of up to 40 identical symbols
+bwt::rle_string random_rle_string(size_t n) {
+	std::srand(1);
+	bwt::rle_string bwt;
+	for(size_t i=0;i<n;++i) {
+		uint8_t c = std::rand() % 5;
+		for(int l=1+std::rand()%40;l>0;--l) bwt.push_back(c);
+	}
+	return bwt;
+}
+
+void test_parallel_build() {
+	// random string large enough to be split in several chunks
+	bwt::rle_string bwt = random_rle_string(1000000);
+	
+	// marks built in parallel are identical to the serial ones
+	auto read_file = [](const std::string& filename) {
+		std::ifstream is(filename,std::ios::binary);
+		return std::string(std::istreambuf_iterator<char>(is),std::istreambuf_iterator<char>());
+	};
+	bwt::fm_index<5>(bwt,1).save("test_serial.fmi");
+	bwt::fm_index<5>(bwt,7).save("test_parallel.fmi");
+	assert(read_file("test_serial.fmi")==read_file("test_parallel.fmi"));
+	std::remove("test_serial.fmi");
+	std::remove("test_parallel.fmi");
+}
+
+
+void test_occ_pair() {
+	bwt::fm_index<5> fm(random_rle_string(10000));
+	const uint64_t n = fm.bwt().size();
+	for(uint64_t i=0;i<n;i+=7) {
+		for(uint64_t w:{0,1,3,30,100,127,128,500,70000}) {
+			if (i+w>=n) continue;
+			auto p = fm.occ_pair(i,i+w);
+			assert(p.first==fm.occ(i) && p.second==fm.occ(i+w));
+		}
+	}
+}
+
+void test_simd() {
+	// all the run decoding kernels supported by the cpu give the same ranks
+	bwt::fm_index<5> fm(random_rle_string(10000));
+	bwt::fm_index<5> ref(fm.bwt());
+	ref.set_simd_level(bwt::SIMD_SCALAR);
+	for(int level=bwt::SIMD_SCALAR;level<=bwt::detect_simd_level();++level) {
+		fm.set_simd_level(static_cast<bwt::simd_level>(level));
+		for(uint64_t i=0;i<fm.bwt().size();i+=3) assert(fm.occ(i)==ref.occ(i));
+	}
+	
+	// the debugging informations report the kernel selected, not the best one of the cpu
+	std::ostringstream os;
+	ref.print_debug_info(os);
+	assert(os.str().find("simd:scalar\n")!=std::string::npos);
+}
+
+void test_interleaved_marks() {
+	// the interleaved layout gives the same ranks as the split one
+	bwt::rle_string bwt = random_rle_string(10000);
+	bwt::fm_index<5> fm(bwt);
+	bwt::fm_index<5,bwt::interleaved_marks> ifm(bwt,3);
+	const uint64_t n = fm.bwt().size();
+	for(uint64_t i=0;i<n;i+=3) {
+		assert(ifm.occ(i)==fm.occ(i));
+		assert(ifm[i]==fm[i]);
+		if (i+100<n) assert(ifm.occ_pair(i,i+100)==fm.occ_pair(i,i+100));
+	}
+	
+	// it is serialized, and an index saved with another layout is rejected
+	ifm.save("test_interleaved.fmi");
+	fm.save("test_split.fmi");
+	bwt::fm_index<5,bwt::interleaved_marks> ifm2(bwt,"test_interleaved.fmi");
+	for(uint64_t i=0;i<n;i+=3) assert(ifm2.occ(i)==fm.occ(i));
+	bool rejected = false;
+	try {bwt::fm_index<5,bwt::interleaved_marks>(bwt,"test_split.fmi");} catch(const std::runtime_error&) {rejected = true;}
+	assert(rejected);
+	std::remove("test_interleaved.fmi");
+	std::remove("test_split.fmi");
+}
+
+//! \brief build the bwt of a collection of strings by sorting all their suffixes, $ of string i being smaller than $ of string j when i<j
+bwt::rle_string naive_collection_bwt(const std::vector<std::string>& strs) {
+	std::vector< std::pair<size_t,size_t> > suffixes;
+	for(size_t i=0;i<strs.size();++i) for(size_t j=0;j<=strs[i].size();++j) suffixes.push_back(std::make_pair(i,j));
+	std::sort(suffixes.begin(),suffixes.end(),[&](const std::pair<size_t,size_t>& a,const std::pair<size_t,size_t>& b) {
+		const std::string &x = strs[a.first], &y = strs[b.first];
+		for(size_t i=a.second,j=b.second;;++i,++j) {
+			if (i==x.size() || j==y.size()) return (i==x.size() && j==y.size()) ? a.first<b.first : i==x.size();
+			if (x[i]!=y[j]) return x[i]<y[j];
+		}
+	});
+	bwt::rle_string bwt;
+	for(const auto& p:suffixes) bwt.push_back(p.second ? strs[p.first][p.second-1] : 0);
+	return bwt;
+}
+
+void test_sampling() {
+	// any sampling gives the same ranks as the default one, with both layouts
+	bwt::rle_string bwt = random_rle_string(10000);
+	bwt::fm_index<5> fm(bwt);
+	for(unsigned s16:{3,5,9,16}) {
+		bwt::fm_sampling sampling(s16);
+		bwt::fm_index<5> sfm(bwt,3,sampling);
+		bwt::fm_index<5,bwt::interleaved_marks> ifm(bwt,2,sampling);
+		const uint64_t n = fm.bwt().size();
+		for(uint64_t i=0;i<n;i+=7) {
+			assert(sfm.occ(i)==fm.occ(i));
+			assert(ifm.occ(i)==fm.occ(i));
+			if (i+100<n) assert(sfm.occ_pair(i,i+100)==fm.occ_pair(i,i+100));
+		}
+		
+		// the sampling is kept by the saved index
+		sfm.save("test_sampling.fmi");
+		bwt::fm_index<5> sfm2(bwt,"test_sampling.fmi");
+		assert(sfm2.sampling().shift16==s16 && sfm2.sampling().shift64==16);
+		for(uint64_t i=0;i<n;i+=7) assert(sfm2.occ(i)==fm.occ(i));
+	}
+	std::remove("test_sampling.fmi");
+	
+	// the index saved next to a bwt file is loaded unless another sampling is requested
+	const auto sparse = bwt::fm_sampling::sparse(), dense = bwt::fm_sampling::dense();
+	bwt::write_rle_bwt("test_sampling.bwt",bwt);
+	bwt::fm_index<5>(bwt,1,sparse).save(bwt::fm_index_filename("test_sampling.bwt"));
+	assert(bwt::read_fm_index_sampling(bwt::fm_index_filename("test_sampling.bwt"))==sparse);
+	const auto saved = bwt::dna_index::load("test_sampling.bwt");
+	const auto same = bwt::dna_index::load("test_sampling.bwt",bwt::dna_index::AUTO_BACKEND,&sparse);
+	const auto built = bwt::dna_index::load("test_sampling.bwt",bwt::dna_index::RLE_BACKEND,&dense);
+	assert(saved.backend()==bwt::dna_index::RLE_BACKEND && built.backend()==bwt::dna_index::RLE_BACKEND);
+	assert(same.marks_bytes()==saved.marks_bytes() && built.marks_bytes() > saved.marks_bytes());
+	for(uint64_t i=0;i<fm.bwt().size();i+=7) assert(saved.occ(i)==fm.occ(i) && built.occ(i)==fm.occ(i));
+	std::remove(bwt::fm_index_filename("test_sampling.bwt").c_str());
+	std::remove("test_sampling.bwt");
+	
+	// denser marks mean fewer runs to scan
+	assert(bwt::fm_index<5>(bwt,1,bwt::fm_sampling::dense()).expected_scanned_runs() < fm.expected_scanned_runs());
+	assert(bwt::fm_sampling::parse("512").shift16==9);
+	bool rejected = false;
+	try {bwt::fm_sampling::parse("100");} catch(const std::invalid_argument&) {rejected = true;}
+	assert(rejected);
+}
+
+void test_packed_index() {
+	// the packed index gives the same ranks as the run-length one, on strings with short runs spanning several superblocks
+	for(size_t n:{0,1,191,192,193,200000}) {
+		std::srand(n);
+		bwt::rle_string bwt;
+		for(size_t i=0;i<n;++i) bwt.push_back(std::rand() % 16 == 0 ? 0 : 1 + std::rand() % 4);
+		bwt::fm_index<5> fm(bwt);
+		bwt::packed_dna_index pfm(bwt,3);
+		assert(pfm.C()==fm.C());
+		for(uint64_t i=0;i<n;++i) {
+			assert(pfm.occ(i)==fm.occ(i));
+			assert(pfm[i]==fm[i]);
+		}
+		for(int level=bwt::SIMD_SCALAR;level<=bwt::detect_simd_level();++level) {
+			pfm.set_simd_level(static_cast<bwt::simd_level>(level));
+			for(uint64_t i=0;i<n;i+=7) assert(pfm.occ(i)==fm.occ(i));
+		}
+		
+		// the backend is chosen from the average run length
+		bwt::dna_index dfm(bwt);
+		assert(n==0 || dfm.backend()==bwt::dna_index::PACKED_BACKEND);
+		for(uint64_t i=0;i<n;i+=5) assert(dfm.occ(i)==fm.occ(i));
+	}
+	assert(bwt::dna_index(random_rle_string(1000)).backend()==bwt::dna_index::RLE_BACKEND);
+}
+
+void test_run_index() {
+	// the run index gives the same ranks as the run-length one, with maximal runs from 1 to thousands of symbols
+	for(size_t max_run:{1,2,40,5000}) {
+		for(size_t n:{0,1,100,100000}) {
+			std::srand(n + max_run);
+			bwt::rle_string bwt;
+			while (bwt.size()<n) bwt.append(std::rand() % 5,1 + std::rand() % max_run);
+			bwt::fm_index<5> fm(bwt);
+			bwt::run_dna_index rfm(bwt);
+			assert(rfm.C()==fm.C());
+			for(uint64_t i=0;i<bwt.size();++i) {
+				assert(rfm.occ(i)==fm.occ(i));
+				assert(rfm[i]==fm[i]);
+				assert(rfm.lf_step(i)==fm.lf_step(i));
+			}
+		}
+	}
+	
+	// its size depends on the number of maximal runs only
+	bwt::rle_string bwt;
+	for(int i=0;i<1000;++i) bwt.append(1 + i%4,10000);
+	const bwt::dna_index rfm(bwt,1,bwt::fm_sampling(),bwt::dna_index::RUNS_BACKEND);
+	assert(rfm.backend()==bwt::dna_index::RUNS_BACKEND);
+	assert(rfm.marks_bytes() < bwt.runs().size() / 10);
+	const bwt::fm_index<5> fm(bwt);
+	for(uint64_t i=0;i<bwt.size();i+=997) assert(rfm.occ(i)==fm.occ(i));
+}
+
+template<size_t AlphabetSize>
+void check_compressed_index(const bwt::rle_string& bwt, bwt::fm_sampling sampling) {
+	const bwt::fm_index<AlphabetSize> fm(bwt);
+	bwt::compressed_fm_index<AlphabetSize> cfm(bwt,sampling);
+	assert(cfm.C()==fm.C());
+	for(bool cache:{true,false}) {
+		cfm.set_cache(cache);
+		for(uint64_t i=0;i<bwt.size();++i) {
+			assert(cfm.occ(i)==fm.occ(i));
+			assert(cfm[i]==fm[i]);
+			assert(cfm.lf_step(i)==fm.lf_step(i));
+			const uint64_t j = std::min<uint64_t>(bwt.size()-1,i + std::rand() % 20);
+			assert(cfm.occ_pair(i,j)==fm.occ_pair(i,j));
+		}
+	}
+}
+
+void test_compressed_index() {
+	// the compressed index gives the same ranks as the run-length one, for blocks from 8 symbols to the large marks
+	// interval, with runs crossing several blocks
+	for(size_t max_run:{1,2,40,5000}) {
+		for(size_t n:{0,1,100,30000}) {
+			std::srand(n + max_run);
+			bwt::rle_string bwt;
+			while (bwt.size()<n) bwt.append(std::rand() % 5,1 + std::rand() % max_run);
+			check_compressed_index<5>(bwt,bwt::fm_sampling());
+			check_compressed_index<5>(bwt,bwt::fm_sampling(3,6));
+			check_compressed_index<5>(bwt,bwt::fm_sampling(10,10));
+		}
+	}
+
+	// skewed symbols, whose Huffman codes exceed the length limit before flattening
+	bwt::rle_string skewed;
+	for(int i=0;i<100000;++i) skewed.append(std::min(7,__builtin_ctz(1 + std::rand())),1 + __builtin_ctz(1 + std::rand()) % 31);
+	check_compressed_index<8>(skewed,bwt::fm_sampling(5));
+
+	// indices sharing the cache of the thread with the same blocks
+	bwt::rle_string a = random_rle_string(5000), b = random_rle_string(5000);
+	const bwt::compressed_fm_index<5> ca(a), cb(b);
+	const bwt::fm_index<5> fa(a), fb(b);
+	for(uint64_t i=0;i<5000;++i) assert(ca.occ(i)==fa.occ(i) && cb.occ(i)==fb.occ(i));
+
+	// the coded runs and the marks take less memory than the runs, once the decoding tables are amortized
+	bwt::rle_string bwt;
+	for(int i=0;i<1000000;++i) bwt.append(1 + i%4,std::rand() % 2 ? 31 : 1 + std::rand() % 4);
+	const bwt::dna_index cfm(bwt,1,bwt::fm_sampling::sparse(),bwt::dna_index::COMPRESSED_BACKEND);
+	assert(cfm.backend()==bwt::dna_index::COMPRESSED_BACKEND);
+	assert(cfm.marks_bytes() < bwt.runs().size() * 2 / 3);
+	const bwt::fm_index<5> fm(bwt);
+	for(uint64_t i=0;i<bwt.size();i+=9973) assert(cfm.occ(i)==fm.occ(i));
+}
+
+void test_qmer_table() {
+	// searches starting from the table give the same intervals as the full backward searches
+	std::srand(3);
+	std::vector<std::string> strs(50);
+	for(auto& s:strs) for(int i=0;i<40;++i) s.push_back(1 + std::rand() % 4);
+	bwt::fm_index<5> fm(naive_collection_bwt(strs));
+	bwt::qmer_table table(fm,4,3);
+	for(const auto& s:strs) {
+		for(size_t i=0;i<s.size();i+=3) {
+			for(size_t len=1;i+len<=s.size() && len<10;++len) {
+				const auto r = bwt::backward_search(fm,s.begin()+i,s.begin()+i+len);
+				assert(bwt::backward_search(fm,table,s.begin()+i,s.begin()+i+len)==r);
+				assert(r.first<r.second);
+			}
+		}
+	}
+	
+	// all q-mers, absent ones having an empty interval, but the strings with a sentinel that aren't in the table
+	std::pair<uint64_t,uint64_t> range;
+	for(int i=0;i<256;++i) {
+		const std::string q = {char(1+(i>>6)),char(1+((i>>4)&3)),char(1+((i>>2)&3)),char(1+(i&3))};
+		const auto r = bwt::backward_search(fm,q.begin(),q.end());
+		assert(table.lookup(q.begin(),range));
+		assert(r.first<r.second ? range==r : range.first>=range.second);
+	}
+	const std::string sentinel = {1,0,2,3};
+	assert(!table.lookup(sentinel.begin(),range));
+	
+	// the table is serialized, and rejected for another bwt
+	table.save("test.qmt");
+	bwt::qmer_table table2(fm,"test.qmt");
+	assert(table2.q()==4);
+	for(size_t i=0;i+8<=strs[0].size();++i) {
+		assert(bwt::backward_search(fm,table2,strs[0].begin()+i,strs[0].begin()+i+8)==bwt::backward_search(fm,strs[0].begin()+i,strs[0].begin()+i+8));
+	}
+	bool rejected = false;
+	try {bwt::qmer_table(bwt::fm_index<5>(random_rle_string(100)),"test.qmt");} catch(const std::runtime_error&) {rejected = true;}
+	assert(rejected);
+	std::remove("test.qmt");
+}
+
+template<typename Index>
+void check_batch_search(const Index& fm, const std::vector<std::string>& patterns) {
+	std::vector< std::pair<uint64_t,uint64_t> > ranges;
+	for(size_t batch_size:{1,7,32}) {
+		bwt::backward_search_batch(fm,patterns,ranges,batch_size);
+		for(size_t j=0;j<patterns.size();++j) assert(ranges[j]==bwt::backward_search(fm,patterns[j].begin(),patterns[j].end()));
+	}
+}
+
+void test_kmer_table() {
+	// the records written to a binary k-mer table are read back, for k-mers not filling their last byte and counts of
+	// one to ten varint bytes
+	const std::vector<uint64_t> values = {0,1,127,128,16383,16384,uint64_t(1)<<32,UINT64_MAX};
+	auto header = [](unsigned k, unsigned num_files) {
+		bwt::kmer_table_header h;
+		std::memset(&h,0,sizeof(h));
+		h.magic_number = bwt::kmer_table_header::magic;
+		h.version = bwt::kmer_table_header::current_version;
+		h.kmer_length = k;
+		h.num_files = num_files;
+		return h;
+	};
+	auto write = [](const bwt::kmer_table_header& h, const std::string& records) {
+		std::ofstream os("test.kmt",std::ios::binary);
+		os.write(reinterpret_cast<const char*>(&h),sizeof(h));
+		os.write(records.data(),records.size());
+	};
+	for(unsigned k:{1,4,5,31,32}) {
+		for(unsigned num_files:{1,3}) {
+			std::srand(k + num_files);
+			std::vector<std::string> kmers(50);
+			std::vector< std::vector<uint64_t> > counts(kmers.size());
+			std::string records;
+			for(size_t r=0;r<kmers.size();++r) {
+				for(unsigned i=0;i<k;++i) kmers[r].push_back(std::rand() % 4);
+				bwt::append_packed_kmer(records,kmers[r]);
+				for(unsigned j=0;j<2*num_files;++j) {
+					counts[r].push_back(values[(r + j) % values.size()]);
+					bwt::append_varint(records,counts[r].back());
+				}
+			}
+			assert(records.size() >= kmers.size() * bwt::kmer_bytes(k));
+			write(header(k,num_files),records);
+			
+			bwt::kmer_table_reader table("test.kmt");
+			assert(table.header().kmer_length==k && table.header().num_files==num_files);
+			std::string kmer;
+			std::vector<uint64_t> c;
+			for(size_t r=0;r<kmers.size();++r) {
+				assert(table.next(kmer,c));
+				assert(kmer==kmers[r] && c==counts[r]);
+			}
+			assert(!table.next(kmer,c));
+			
+			// a record cut in its k-mer or in a count is rejected
+			for(size_t cut:{size_t(1),bwt::kmer_bytes(k) + 1}) {
+				write(header(k,num_files),records.substr(0,records.size() - cut));
+				bwt::kmer_table_reader truncated("test.kmt");
+				bool rejected = false;
+				try {while (truncated.next(kmer,c));} catch(const std::runtime_error&) {rejected = true;}
+				assert(rejected);
+			}
+		}
+	}
+	
+	// a bad magic number or version is rejected
+	for(int field=0;field<2;++field) {
+		auto h = header(5,1);
+		if (field==0) h.magic_number = 0; else h.version = bwt::kmer_table_header::current_version + 1;
+		std::string records;
+		bwt::append_packed_kmer(records,std::string(5,'\1'));
+		bwt::append_varint(records,1);
+		bwt::append_varint(records,2);
+		write(h,records);
+		bool rejected = false;
+		try {bwt::kmer_table_reader table("test.kmt");} catch(const std::runtime_error&) {rejected = true;}
+		assert(rejected);
+	}
+	std::remove("test.kmt");
+}
+
+void test_batch_search() {
+	// batched searches give the same intervals as the searches one at a time, with all the backends
+	std::srand(4);
+	std::vector<std::string> strs(100);
+	for(auto& s:strs) for(int i=0;i<50;++i) s.push_back(1 + std::rand() % 4);
+	bwt::rle_string bwt = naive_collection_bwt(strs);
+	std::vector<std::string> patterns;
+	for(const auto& s:strs) for(size_t len=0;len<20;len+=3) patterns.push_back(s.substr(std::rand() % (s.size()-len),len));
+	for(int i=0;i<100;++i) patterns.push_back(std::string(1 + std::rand() % 10,1 + std::rand() % 4));
+	check_batch_search(bwt::fm_index<5>(bwt),patterns);
+	check_batch_search(bwt::fm_index<5,bwt::interleaved_marks>(bwt),patterns);
+	check_batch_search(bwt::packed_dna_index(bwt),patterns);
+	check_batch_search(bwt::dna_index(bwt),patterns);
+	check_batch_search(bwt::run_dna_index(bwt),patterns);
+	check_batch_search(bwt::compressed_fm_index<5>(bwt),patterns);
+}
+
+template<typename Index>
+void check_locate(const Index& fm, const bwt::sampled_suffix_array& sa, const std::vector<std::string>& strs) {
+	// row s is the suffix "$" of string s, and the LF step of a row moves to the previous offset of its string
+	for(uint64_t i=0;i<fm.bwt().size();++i) {
+		const auto p = sa.locate(fm,i);
+		assert(p.string<strs.size() && p.offset<=strs[p.string].size());
+		if (i<strs.size()) assert(p.string==i && p.offset==strs[i].size());
+		if (p.offset==0) {
+			assert(fm[i]==0);
+		} else {
+			assert(fm[i]==strs[p.string][p.offset-1]);
+			assert((sa.locate(fm,fm.lf(i)[fm[i]]-1)==bwt::sampled_suffix_array::position_t{p.string,p.offset-1}));
+		}
+	}
+}
+
+void test_locate() {
+	// every row is located, whatever the sampling rate and the backend
+	std::srand(5);
+	std::vector<std::string> strs(60);
+	for(auto& s:strs) for(int i=std::rand()%70;i>0;--i) s.push_back(1 + std::rand() % 4);
+	bwt::rle_string bwt = naive_collection_bwt(strs);
+	bwt::fm_index<5> fm(bwt);
+	for(unsigned rate:{1,3,32,1000}) check_locate(fm,bwt::sampled_suffix_array(fm,rate,3),strs);
+	for(size_t n:{1,20,39}) {
+		// bit vectors ending in a partial block of the rank directory
+		std::vector<std::string> head(strs.begin(),strs.begin()+n);
+		bwt::fm_index<5> hfm(naive_collection_bwt(head));
+		check_locate(hfm,bwt::sampled_suffix_array(hfm,4,2),head);
+	}
+	bwt::sampled_suffix_array sa(fm,8,2);
+	check_locate(bwt::packed_dna_index(bwt),sa,strs);
+	check_locate(bwt::dna_index(bwt),sa,strs);
+	
+	// the samples are serialized, and rejected for another bwt
+	sa.save("test.ssa");
+	bwt::sampled_suffix_array sa2(fm,"test.ssa");
+	assert(sa2.rate()==8 && sa2.bytes()==sa.bytes());
+	check_locate(fm,sa2,strs);
+	bool rejected = false;
+	try {bwt::sampled_suffix_array(bwt::fm_index<5>(random_rle_string(100)),"test.ssa");} catch(const std::runtime_error&) {rejected = true;}
+	assert(rejected);
+	std::remove("test.ssa");
+}
+
+template<typename Index>
+void check_extract(const Index& fm, const std::vector<std::string>& strs) {
+	std::vector<uint64_t> rows(strs.size()), ends;
+	std::vector<std::string> extracted;
+	for(size_t s=0;s<rows.size();++s) rows[s] = s;
+	for(size_t batch_size:{1,7,32}) {
+		bwt::extract_batch(fm,rows,extracted,ends,batch_size);
+		assert(extracted==strs);
+		for(size_t s=0;s<rows.size();++s) assert(fm[ends[s]]==0 && bwt::backward_search(fm,strs[s].begin(),strs[s].end()).first<=ends[s]);
+	}
+}
+
+void test_extract() {
+	// the walks from the sentinels read back the strings of the collection, with all the backends
+	std::srand(6);
+	std::vector<std::string> strs(80);
+	for(auto& s:strs) for(int i=std::rand()%60;i>0;--i) s.push_back(1 + std::rand() % 4);
+	bwt::rle_string bwt = naive_collection_bwt(strs);
+	check_extract(bwt::fm_index<5>(bwt),strs);
+	check_extract(bwt::fm_index<5,bwt::interleaved_marks>(bwt),strs);
+	check_extract(bwt::packed_dna_index(bwt),strs);
+	check_extract(bwt::dna_index(bwt),strs);
+}
+
+bool same_runs(const bwt::rle_string& a, const bwt::rle_string& b) {
+	if (a.size()!=b.size() || a.runs().size()!=b.runs().size()) return false;
+	for(size_t i=0;i<a.runs().size();++i) if (a.runs()[i]._data!=b.runs()[i]._data) return false;
+	return true;
+}
+
+void test_bcr() {
+	// the bwt built by BCR is the one of the sorted suffixes, with short, empty and duplicated strings
+	for(int t=0;t<50;++t) {
+		std::srand(100+t);
+		std::vector<std::string> strs(1 + std::rand() % 40);
+		for(auto& s:strs) for(int i=std::rand() % (t%3 ? 30 : 4);i>0;--i) s.push_back(1 + std::rand() % (t%2 ? 4 : 2));
+		std::string text;
+		for(const auto& s:strs) text += s + '\0';
+		const auto expected = naive_collection_bwt(strs);
+		for(unsigned num_threads:{1,3,8}) assert(same_runs(bwt::bcr_build(text,num_threads),expected));
+	}
+	
+	// the bwt is written in the SGA format
+	std::string text;
+	for(int i=0;i<20;++i) text += std::string("\1\2\3\4\4\2") + '\0';
+	const auto bwt = bwt::bcr_build(text,2);
+	bwt::write_rle_bwt("test.bwt",bwt);
+	assert(same_runs(bwt::read_rle_bwt("test.bwt"),bwt));
+	assert(same_runs(bwt::map_rle_bwt("test.bwt"),bwt));
+	std::remove("test.bwt");
+	
+	// the strings end with a sentinel
+	bool rejected = false;
+	try {bwt::bcr_build(std::string("\1\2"));} catch(const std::invalid_argument&) {rejected = true;}
+	assert(rejected);
+	
+	// the runs appended to a bwt writer are the ones of the string
+	{
+		bwt::rle_bwt_writer os("test.bwt");
+		for(auto r:bwt.runs()) for(int i=0;i<r.length();++i) os.push_back(r.value());
+		os.close();
+	}
+	assert(same_runs(bwt::read_rle_bwt("test.bwt"),bwt));
+	std::remove("test.bwt");
+}
+
+void test_bcr_external() {
+	// the bwt built on disk is the one built in memory, with the smallest budget holding the buffers of one merge, so
+	// that the merges of the 3 threads run one at a time, and with blocks of strings smaller than the collection
+	const uint64_t budget = 39 * 4096 + 20000;
+	for(int t=0;t<21;++t) {
+		std::srand(200+t);
+		std::vector<std::string> strs(t==20 ? 10000 : 1 + std::rand() % 300);
+		for(auto& s:strs) for(int i=std::rand() % (t%3 ? 30 : 4);i>0;--i) s.push_back(1 + std::rand() % (t%2 ? 4 : 2));
+		std::string text;
+		for(const auto& s:strs) text += s + '\0';
+		for(unsigned num_threads:{1,3}) {
+			for(uint64_t memory_budget:{budget,budget * 8}) {
+				{
+					bwt::bcr_external_builder builder("test.bwt.tmp",memory_budget,num_threads);
+					for(const auto& s:strs) builder.add(s);
+					assert(builder.size()==strs.size());
+					builder.build("test.bwt");
+				}
+				assert(same_runs(bwt::read_rle_bwt("test.bwt"),bwt::bcr_build(text)));
+				std::remove("test.bwt");
+			}
+		}
+	}
+	
+	// a budget not holding the buffers of a merge is rejected
+	bool rejected = false;
+	try {
+		bwt::bcr_external_builder builder("test.bwt.tmp",budget - 20000,1);
+		builder.add(std::string("\1\2"));
+		builder.build("test.bwt");
+	} catch(const std::runtime_error&) {rejected = true;}
+	assert(rejected);
+	std::remove("test.bwt");
+}
+
+void test_merge() {
+	// the merged bwt is the one of the concatenated collections, for empty collections, strings and duplicates too
+	for(int t=0;t<30;++t) {
+		std::srand(300+t);
+		std::vector<std::string> strs(std::rand() % 60), more(std::rand() % 60);
+		for(auto* v:{&strs,&more}) for(auto& s:*v) for(int i=std::rand() % (t%3 ? 30 : 4);i>0;--i) s.push_back(1 + std::rand() % (t%2 ? 4 : 2));
+		std::string text;
+		for(const auto& s:more) text += s + '\0';
+		std::vector<std::string> all(strs);
+		all.insert(all.end(),more.begin(),more.end());
+		const auto expected = naive_collection_bwt(all);
+		const bwt::fm_index<5> a(naive_collection_bwt(strs)), b(naive_collection_bwt(more));
+		for(unsigned num_threads:{1,3}) {
+			assert(same_runs(bwt::merge_bwt(a,b,num_threads),expected));
+			assert(same_runs(bwt::append_strings(a,text,num_threads),expected));
+		}
+	}
+	
+	// long runs are copied across the runs of both strings
+	std::vector<std::string> strs(100,std::string(70,1)), more(50,std::string(90,1));
+	std::vector<std::string> all(strs);
+	all.insert(all.end(),more.begin(),more.end());
+	const bwt::fm_index<5> a(naive_collection_bwt(strs)), b(naive_collection_bwt(more));
+	assert(same_runs(bwt::merge_bwt(a,b,2),naive_collection_bwt(all)));
+}
+
+void test_bidirectional() {
+	const std::string alphabet("$ACGT");
+	std::vector<std::string> strs = {"ACGTTGCA","GATTACA","CATCAT","TTAGGACGT"};
+	for(auto& s:strs) std::transform(s.begin(),s.end(),s.begin(),[&](char c){return alphabet.find(c);});
+	bwt::fm_index<5> fm(naive_collection_bwt(strs));
+	for(auto& s:strs) std::reverse(s.begin(),s.end());
+	bwt::fm_index<5> rfm(naive_collection_bwt(strs));
+	for(auto& s:strs) std::reverse(s.begin(),s.end());
+	
+	auto count = [&](const std::string& p) {
+		size_t n = 0;
+		for(const auto& s:strs) for(size_t i=0;i+p.size()<=s.size();++i) n += (s.compare(i,p.size(),p)==0);
+		return n;
+	};
+	
+	// grow all strings of length up to 4 to the right and to the left
+	std::array<bwt::bi_interval,5> ext;
+	std::vector< std::pair<std::string,bwt::bi_interval> > todo(1,std::make_pair(std::string(),bwt::full_range(fm)));
+	while (!todo.empty()) {
+		auto x = todo.back();
+		todo.pop_back();
+		if (x.first.size()>=4) continue;
+		bwt::extend_rhs(rfm,ext,x.second);
+		for(uint8_t c=1;c<5;++c) {
+			assert(ext[c].size==count(x.first + char(c)));
+			todo.push_back(std::make_pair(x.first + char(c),ext[c]));
+		}
+		bwt::extend_lhs(fm,ext,x.second);
+		for(uint8_t c=1;c<5;++c) {
+			assert(ext[c].size==count(char(c) + x.first));
+			todo.push_back(std::make_pair(char(c) + x.first,ext[c]));
+		}
+	}
+}
+
+
 
 int main(int argc, char* argv[]) {
 	test_fm();
+	test_rle_io();
+	test_parallel_build();
+	test_occ_pair();
+	test_simd();
+	test_interleaved_marks();
+	test_sampling();
+	test_packed_index();
+	test_run_index();
+	test_compressed_index();
+	test_qmer_table();
+	test_kmer_table();
+	test_batch_search();
+	test_locate();
+	test_extract();
+	test_bcr();
+	test_bcr_external();
+	test_merge();
+	test_bidirectional();
 	return 0;
 }